@@ -0,0 +1,189 @@
+#pragma once
+
+/*
+ * Shared fixtures of the microbenchmarks: synthetic board images and bags, so the benchmarks run without recorded
+ * data and always measure the same input.
+ * */
+#include "io/dataset_io.h"
+
+#include <apriltags/TagFamily.h>
+#include <apriltags/Tag36h11.h>
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <unistd.h>
+
+namespace bench {
+    // Image sizes of the cameras we calibrate, VGA to 5 MP
+    struct ImageSize {
+        int width;
+        int height;
+    };
+    constexpr ImageSize IMAGE_SIZES[] = {{640, 480}, {1280, 960}, {2448, 2048}};
+
+    /*
+     * Board to image homography that puts a board of board_w x board_h units into the middle of the image, covering
+     * 70% of its smaller side, slightly rotated and tilted so that detection does not see a perfectly aligned board.
+     * */
+    inline Eigen::Matrix3d board_to_image(double board_w, double board_h, const ImageSize &size) {
+        const double scale = 0.7 * std::min(size.width / board_w, size.height / board_h);
+        const double angle = 0.1;
+
+        Eigen::Matrix3d center_board;
+        center_board << 1, 0, -board_w / 2, 0, 1, -board_h / 2, 0, 0, 1;
+        Eigen::Matrix3d rotate_scale;
+        rotate_scale << scale * std::cos(angle), -scale * std::sin(angle), 0, scale * std::sin(angle),
+                scale * std::cos(angle), 0, 0.0001, 0.00005, 1;
+        Eigen::Matrix3d to_image;
+        to_image << 1, 0, size.width / 2.0, 0, 1, size.height / 2.0, 0, 0, 1;
+
+        return to_image * rotate_scale * center_board;
+    }
+
+    /*
+     * Renders value(x, y) in [0, 1], given in board units, through the homography with 2x2 supersampling and
+     * Gaussian noise. Pixels are 16 bit, like the images RosbagDataset returns.
+     * */
+    template<typename F>
+    basalt::ManagedImage<uint16_t> render(const ImageSize &size, const Eigen::Matrix3d &board_to_img, F value) {
+        basalt::ManagedImage<uint16_t> img(size.width, size.height);
+        const Eigen::Matrix3d img_to_board = board_to_img.inverse();
+
+        std::mt19937 rng(42);
+        std::normal_distribution<float> noise(0.f, 3.f);
+
+        for (int y = 0; y < size.height; y++) {
+            uint16_t *row = img.RowPtr(y);
+            for (int x = 0; x < size.width; x++) {
+                float acc = 0.f;
+                for (int s = 0; s < 4; s++) {
+                    const Eigen::Vector3d p =
+                            img_to_board * Eigen::Vector3d(x + 0.25 + 0.5 * (s & 1), y + 0.25 + 0.5 * (s >> 1), 1.0);
+                    acc += value(p[0] / p[2], p[1] / p[2]);
+                }
+                const float v = std::clamp(40.f + 180.f * acc / 4.f + noise(rng), 0.f, 255.f);
+                row[x] = static_cast<uint16_t>(v) << 8;
+            }
+        }
+        return img;
+    }
+
+    /*
+     * AprilGrid of cols x rows 36h11 tags, in units of tag bits: a tag is 10 bits wide (6 data bits and a 2 bit black
+     * border on each side), tags are 3 bits apart.
+     * */
+    inline basalt::ManagedImage<uint16_t> render_aprilgrid(const ImageSize &size, int cols, int rows) {
+        const double pitch = 13.0;
+        const double margin = 3.0;
+        const double board_w = cols * pitch - 3.0 + 2 * margin;
+        const double board_h = rows * pitch - 3.0 + 2 * margin;
+
+        return render(size, board_to_image(board_w, board_h, size), [&](double bx, double by) {
+            bx -= margin;
+            by -= margin;
+            if (bx < 0 || by < 0) return 1.f;
+
+            const int tx = static_cast<int>(bx / pitch);
+            const int ty = static_cast<int>(by / pitch);
+            if (tx >= cols || ty >= rows) return 1.f;
+
+            const int cx = static_cast<int>(bx - tx * pitch);
+            const int cy = static_cast<int>(by - ty * pitch);
+            if (cx >= 10 || cy >= 10) return 1.f;
+            if (cx < 2 || cy < 2 || cx >= 8 || cy >= 8) return 0.f;
+
+            const unsigned long long code = AprilTags::t36h11[ty * cols + tx];
+            return static_cast<float>((code >> (35 - ((cy - 2) * 6 + (cx - 2)))) & 1);
+        });
+    }
+
+    // Checkerboard with cols x rows inner corners, in units of squares
+    inline basalt::ManagedImage<uint16_t> render_checkerboard(const ImageSize &size, int cols, int rows) {
+        const double margin = 1.0;
+        const double board_w = cols + 1 + 2 * margin;
+        const double board_h = rows + 1 + 2 * margin;
+
+        return render(size, board_to_image(board_w, board_h, size), [&](double bx, double by) {
+            bx -= margin;
+            by -= margin;
+            if (bx < 0 || by < 0 || bx >= cols + 1 || by >= rows + 1) return 1.f;
+            return static_cast<float>((static_cast<int>(bx) + static_cast<int>(by)) & 1);
+        });
+    }
+
+    // Converts a 16 bit image to a sensor_msgs/Image of the given encoding (mono8, mono16 or rgb8)
+    inline sensor_msgs::ImagePtr to_msg(const basalt::ManagedImage<uint16_t> &img, const std::string &encoding,
+                                        int64_t timestamp_ns) {
+        sensor_msgs::ImagePtr msg(new sensor_msgs::Image);
+        msg->header.stamp.fromNSec(timestamp_ns);
+        msg->width = img.w;
+        msg->height = img.h;
+        msg->encoding = encoding;
+        msg->is_bigendian = false;
+
+        const size_t n = img.w * img.h;
+        if (encoding == "mono16") {
+            msg->step = img.w * 2;
+            msg->data.resize(n * 2);
+            for (size_t y = 0; y < img.h; y++) {
+                std::memcpy(&msg->data[y * msg->step], img.RowPtr(y), msg->step);
+            }
+        } else {
+            const size_t channels = encoding == "rgb8" ? 3 : 1;
+            msg->step = img.w * channels;
+            msg->data.resize(n * channels);
+            for (size_t y = 0; y < img.h; y++) {
+                const uint16_t *row = img.RowPtr(y);
+                for (size_t x = 0; x < img.w; x++) {
+                    for (size_t c = 0; c < channels; c++) {
+                        msg->data[(y * img.w + x) * channels + c] = static_cast<uint8_t>(row[x] >> 8);
+                    }
+                }
+            }
+        }
+        return msg;
+    }
+
+    /*
+     * Writes a bag with num_cams cameras of num_frames frames each at 20 Hz and IMU samples at 200 Hz, every frame
+     * is img in the given encoding.
+     * */
+    inline void write_bag(const std::string &path, const basalt::ManagedImage<uint16_t> &img,
+                          const std::string &encoding, int num_cams, int num_frames) {
+        rosbag::Bag bag;
+        bag.open(path, rosbag::bagmode::Write);
+
+        const int64_t frame_ns = 50'000'000;
+        const int64_t imu_ns = 5'000'000;
+        const int64_t t0_ns = 1'000'000'000;
+
+        for (int64_t t_ns = t0_ns; t_ns < t0_ns + num_frames * frame_ns; t_ns += imu_ns) {
+            ros::Time t;
+            t.fromNSec(t_ns);
+
+            sensor_msgs::Imu imu;
+            imu.header.stamp = t;
+            imu.linear_acceleration.z = 9.81;
+            bag.write("/imu0", t, imu);
+
+            if ((t_ns - t0_ns) % frame_ns == 0) {
+                const auto msg = to_msg(img, encoding, t_ns);
+                for (int cam = 0; cam < num_cams; cam++) {
+                    bag.write("/cam" + std::to_string(cam) + "/image_raw", t, msg);
+                }
+            }
+        }
+        bag.close();
+    }
+
+    // Path in the temporary directory, unique per process
+    inline std::string temp_path(const std::string &name) {
+        return (basalt::fs::temp_directory_path() / ("calib_bench_" + std::to_string(::getpid()) + "_" + name)).string();
+    }
+}// namespace bench
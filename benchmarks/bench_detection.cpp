@@ -0,0 +1,70 @@
+#include "bench_common.hpp"
+
+#include "calibration/calibration_data.hpp"
+
+#include <benchmark/benchmark.h>
+
+/*
+ * Detection benchmarks, every image size times a sparse, a typical and a dense board. Arguments are
+ * {index into IMAGE_SIZES, board columns, board rows}.
+ * */
+namespace {
+    void board_args(benchmark::internal::Benchmark *b, std::initializer_list<std::pair<int, int>> boards) {
+        b->ArgNames({"size", "cols", "rows"});
+        for (int size = 0; size < static_cast<int>(std::size(bench::IMAGE_SIZES)); size++) {
+            for (const auto &board: boards) {
+                b->Args({size, board.first, board.second});
+            }
+        }
+        b->Unit(benchmark::kMillisecond);
+    }
+
+    void set_counters(benchmark::State &state, const bench::ImageSize &size, size_t corners) {
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * size.width * size.height);
+        state.counters["corners"] = static_cast<double>(corners);
+        state.SetLabel(std::to_string(size.width) + "x" + std::to_string(size.height));
+    }
+
+    void BM_DetectTags(benchmark::State &state) {
+        const bench::ImageSize size = bench::IMAGE_SIZES[state.range(0)];
+        const int cols = static_cast<int>(state.range(1));
+        const int rows = static_cast<int>(state.range(2));
+        const auto img = bench::render_aprilgrid(size, cols, rows);
+
+        basalt::ApriltagDetector detector(cols * rows, "36h11");
+        Eigen::aligned_vector<Eigen::Vector2d> corners, corners_rejected;
+        std::vector<int> ids, ids_rejected;
+        std::vector<double> radii, radii_rejected;
+
+        for (auto _: state) {
+            detector.detectTags(img, corners, ids, radii, corners_rejected, ids_rejected, radii_rejected);
+            benchmark::DoNotOptimize(corners.data());
+        }
+        set_counters(state, size, corners.size());
+    }
+    BENCHMARK(BM_DetectTags)->Apply([](benchmark::internal::Benchmark *b) {
+        board_args(b, {{4, 3}, {6, 6}, {10, 8}});
+    });
+
+    void BM_CheckerboardProcess(benchmark::State &state) {
+        const bench::ImageSize size = bench::IMAGE_SIZES[state.range(0)];
+        const int cols = static_cast<int>(state.range(1));
+        const int rows = static_cast<int>(state.range(2));
+        auto img = bench::render_checkerboard(size, cols, rows);
+
+        basalt::OpenCVCheckerboardParams params(cols, rows, true, true, true, true, true);
+        size_t corners = 0;
+
+        for (auto _: state) {
+            basalt::CalibCornerData good, bad;
+            params.process(img, good, bad);
+            corners = good.corners.size();
+            benchmark::DoNotOptimize(good.corners.data());
+        }
+        set_counters(state, size, corners);
+    }
+    BENCHMARK(BM_CheckerboardProcess)->Apply([](benchmark::internal::Benchmark *b) {
+        board_args(b, {{7, 5}, {11, 8}, {17, 12}});
+    });
+}// namespace
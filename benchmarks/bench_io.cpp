@@ -0,0 +1,156 @@
+#include "bench_common.hpp"
+
+#include "calibration/calibrator.hpp"
+#include "recorder/better_bag.hpp"
+
+#include <benchmark/benchmark.h>
+
+/*
+ * I/O benchmarks on synthetic bags in the temporary directory. Every bag holds an AprilGrid image so that the frames
+ * compress and read like recorded ones.
+ * */
+namespace {
+    const char *ENCODINGS[] = {"mono8", "mono16", "rgb8"};
+
+    // Removes the file when the benchmark is done, also when it is skipped
+    struct TempFile {
+        explicit TempFile(const std::string &name) : path(bench::temp_path(name)) {}
+        ~TempFile() { basalt::fs::remove(this->path); }
+
+        std::string path;
+    };
+
+    void size_args(benchmark::internal::Benchmark *b, const char *first_name, int first_count) {
+        b->ArgNames({first_name, "size"});
+        for (int first = 0; first < first_count; first++) {
+            for (int size = 0; size < static_cast<int>(std::size(bench::IMAGE_SIZES)); size++) {
+                b->Args({first, size});
+            }
+        }
+        b->Unit(benchmark::kMillisecond);
+    }
+
+    // Decoding one frame of every camera, per encoding
+    void BM_GetImageData(benchmark::State &state) {
+        const std::string encoding = ENCODINGS[state.range(0)];
+        const bench::ImageSize size = bench::IMAGE_SIZES[state.range(1)];
+        const int num_cams = 2;
+
+        TempFile bag("get_image_data.bag");
+        bench::write_bag(bag.path, bench::render_aprilgrid(size, 6, 6), encoding, num_cams, 10);
+        basalt::RosbagDataset dataset(bag.path, false);
+        const auto timestamps = dataset.get_image_timestamps();
+
+        size_t i = 0;
+        for (auto _: state) {
+            auto data = dataset.get_image_data(timestamps[i++ % timestamps.size()]);
+            benchmark::DoNotOptimize(data.data());
+        }
+        state.SetItemsProcessed(state.iterations() * num_cams);
+        state.SetBytesProcessed(state.iterations() * num_cams * size.width * size.height * sizeof(uint16_t));
+        state.SetLabel(encoding);
+    }
+    BENCHMARK(BM_GetImageData)->Apply([](benchmark::internal::Benchmark *b) {
+        size_args(b, "encoding", static_cast<int>(std::size(ENCODINGS)));
+    });
+
+    // Opening a bag and indexing its images and IMU samples, without the conversion for display
+    void BM_RosbagDatasetRead(benchmark::State &state) {
+        const int num_frames = static_cast<int>(state.range(0));
+        const bench::ImageSize size = bench::IMAGE_SIZES[state.range(1)];
+        const int num_cams = 2;
+
+        TempFile bag("read.bag");
+        bench::write_bag(bag.path, bench::render_aprilgrid(size, 6, 6), "mono8", num_cams, num_frames);
+
+        for (auto _: state) {
+            basalt::RosbagDataset dataset(bag.path, false);
+            benchmark::DoNotOptimize(dataset.get_image_timestamps().data());
+        }
+        state.SetItemsProcessed(state.iterations() * num_frames * num_cams);
+        state.SetBytesProcessed(state.iterations() * basalt::fs::file_size(bag.path));
+    }
+    BENCHMARK(BM_RosbagDatasetRead)
+            ->ArgNames({"frames", "size"})
+            ->ArgsProduct({{20, 100}, {0, 1, 2}})
+            ->Unit(benchmark::kMillisecond);
+
+    // Recording throughput, including the drain of the write queue on close
+    void BM_BetterBagWrite(benchmark::State &state) {
+        const int num_frames = static_cast<int>(state.range(0));
+        const bench::ImageSize size = bench::IMAGE_SIZES[state.range(1)];
+
+        TempFile bag("write.bag");
+        const auto msg = bench::to_msg(bench::render_aprilgrid(size, 6, 6), "mono8", 0);
+
+        for (auto _: state) {
+            vk::BetterBag better_bag;
+            better_bag.openWrite(bag.path);
+            for (int i = 0; i < num_frames; i++) {
+                ros::Time t;
+                t.fromNSec(1'000'000'000 + i * 50'000'000LL);
+                better_bag.write("/cam0/image_raw", t, msg);
+            }
+            better_bag.close();
+        }
+        state.SetItemsProcessed(state.iterations() * num_frames);
+        state.SetBytesProcessed(state.iterations() * num_frames * msg->data.size());
+    }
+    BENCHMARK(BM_BetterBagWrite)
+            ->ArgNames({"frames", "size"})
+            ->ArgsProduct({{100}, {0, 1, 2}})
+            ->Unit(benchmark::kMillisecond);
+
+    /*
+     * Corner cache round trip for num_frames frames of two cameras, each frame seeing a 6x6 AprilGrid (144 corners).
+     * Arguments are {frames, 0 for save and 1 for load}.
+     * */
+    void BM_CornerCache(benchmark::State &state) {
+        const int num_frames = static_cast<int>(state.range(0));
+        const bool load = state.range(1) != 0;
+        const int num_cams = 2;
+        const int num_corners = 144;
+
+        TempFile bag("cache.bag");
+        TempFile cache("cache.corners");
+        TempFile json("cache.json");
+        bench::write_bag(bag.path, bench::render_aprilgrid(bench::IMAGE_SIZES[0], 6, 6), "mono8", num_cams, 1);
+
+        auto dataset = std::make_shared<basalt::RosbagDataset>(bag.path, false);
+        basalt::Calibrator calibrator(dataset);
+        calibrator.set_output_paths(cache.path, json.path);
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> coord(0.0, 640.0);
+        for (int f = 0; f < num_frames; f++) {
+            for (int cam = 0; cam < num_cams; cam++) {
+                basalt::CalibCornerData ccd;
+                for (int i = 0; i < num_corners; i++) {
+                    ccd.corners.emplace_back(coord(rng), coord(rng));
+                    ccd.corner_ids.push_back(i);
+                    ccd.radii.push_back(3.0);
+                }
+                dataset->calib_corners.emplace(basalt::TimeCamId(1'000'000'000 + f * 50'000'000LL, cam),
+                                               basalt::CompactCornerData(ccd));
+            }
+        }
+        // Only names the target in the fingerprint
+        const basalt::OpenCVCheckerboardParams params(7, 5, true, true, true, true, true);
+        calibrator.saveCache(params);
+
+        for (auto _: state) {
+            if (load) {
+                benchmark::DoNotOptimize(calibrator.loadCache(params));
+            } else {
+                calibrator.saveCache(params);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * num_frames * num_cams);
+        state.SetBytesProcessed(state.iterations() * basalt::fs::file_size(cache.path));
+        state.SetLabel(load ? "load" : "save");
+    }
+    BENCHMARK(BM_CornerCache)
+            ->ArgNames({"frames", "load"})
+            ->ArgsProduct({{100, 1000}, {0, 1}})
+            ->Unit(benchmark::kMillisecond);
+}// namespace
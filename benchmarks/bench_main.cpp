@@ -0,0 +1,19 @@
+#include <benchmark/benchmark.h>
+#include <spdlog/spdlog.h>
+
+/*
+ * Runs the calib_bench microbenchmarks, e.g.
+ *   calib_bench --benchmark_filter=DetectTags --benchmark_out=bench.json --benchmark_out_format=json
+ * */
+int main(int argc, char **argv) {
+    // The code under test logs every cache write and bag open, which would drown the results
+    spdlog::set_level(spdlog::level::warn);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
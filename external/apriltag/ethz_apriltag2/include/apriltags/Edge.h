@@ -21,7 +21,7 @@ class Edge {
 public:
   static float const minMag;   //!< minimum intensity gradient for an edge to be recognized
   static float const maxEdgeCost;   //!< 30 degrees = maximum acceptable difference in local orientations
-  static int const WEIGHT_SCALE; // was 10000
+  static int const WEIGHT_SCALE = 100; // was 10000; upper bound of edge costs, sizes the buckets of sortEdges
   static float const thetaThresh; //!< theta threshold for merging edges
   static float const magThresh; //!< magnitude threshold for merging edges
 
@@ -49,8 +49,15 @@ public:
 			const FloatImage& theta, const FloatImage& mag,
 			std::vector<Edge> &edges, size_t &nEdges);
 
-  //! Process edges in order of increasing cost, merging clusters if we can do so without exceeding the thetaThresh.
-  static void mergeEdges(std::vector<Edge> &edges, UnionFindSimple &uf, float tmin[], float tmax[], float mmin[], float mmax[]);
+  //! Stable counting sort of the first nEdges edges in 'edges' by cost, written to the front of 'sorted'.
+  /*! Costs are in [0, WEIGHT_SCALE], so this is linear in nEdges. 'sorted'
+    is only reallocated when it is too small, callers that keep it
+    around between frames sort without allocating.
+   */
+  static void sortEdges(const std::vector<Edge> &edges, size_t nEdges, std::vector<Edge> &sorted);
+
+  //! Process the first nEdges edges in order of increasing cost, merging clusters if we can do so without exceeding the thetaThresh.
+  static void mergeEdges(const std::vector<Edge> &edges, size_t nEdges, UnionFindSimple &uf, float tmin[], float tmax[], float mmin[], float mmax[]);
 
 };
 
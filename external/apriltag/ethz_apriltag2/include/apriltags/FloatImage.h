@@ -33,6 +33,9 @@ class FloatImage {
 
   FloatImage& operator=(const FloatImage& other);
 
+  //! Change the size, keeping the allocated storage. Pixel values are unspecified afterwards.
+  void resize(int widthArg, int heightArg);
+
   float get(int x, int y) const { return pixels[y * width + x]; }
   void set(int x, int y, float v) { pixels[y * width + x] = v; }
 
@@ -40,6 +43,7 @@ class FloatImage {
   int getHeight() const { return height; }
   int getNumFloatImagePixels() const { return width * height; }
   const std::vector<float>& getFloatImagePixels() const { return pixels; }
+  std::vector<float>& getFloatImagePixels() { return pixels; }
 
   //! TODO: Fix decimateAvg function. DO NOT USE!
   void decimateAvg();
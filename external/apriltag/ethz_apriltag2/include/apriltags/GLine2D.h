@@ -2,6 +2,7 @@
 #define GLINE2D_H
 
 #include <cmath>
+#include <cstddef>
 #include <utility>
 #include <vector>
 
@@ -53,6 +54,9 @@ public:
 
   static GLine2D lsqFitXYW(const std::vector<XYWeight>& xyweights);
 
+  //! Fits a line to the n weighted points starting at xyweights.
+  static GLine2D lsqFitXYW(const XYWeight* xyweights, size_t n);
+
   inline float getDx() const { return dx; }
   inline float getDy() const { return dy; }
   inline float getFirst() const { return p.first; }
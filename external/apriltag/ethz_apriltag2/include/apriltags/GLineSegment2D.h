@@ -16,6 +16,7 @@ class GLineSegment2D {
 public:
   GLineSegment2D(const std::pair<float,float> &p0Arg, const std::pair<float,float> &p1Arg);
   static GLineSegment2D lsqFitXYW(const std::vector<XYWeight>& xyweight);
+  static GLineSegment2D lsqFitXYW(const XYWeight* xyweight, size_t n);
   std::pair<float,float> getP0() const { return p0; }
   std::pair<float,float> getP1() const { return p1; }
 
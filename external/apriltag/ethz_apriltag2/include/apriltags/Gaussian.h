@@ -2,6 +2,8 @@
 #define GAUSSIAN_H
 
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace AprilTags {
@@ -29,7 +31,26 @@ public:
    */
   static void convolveSymmetricCentered(const std::vector<float>& a, unsigned int aoff, unsigned int alen,
 					const std::vector<float>& f, std::vector<float>& r, unsigned int roff);
-  
+
+  //! Number of fractional bits of fixed point filters and filtered images.
+  static int const FIXED_POINT_BITS = 8;
+
+  //! Quantizes a normalized filter (e.g. from makeGaussianFilter) to fixed point, the taps sum to exactly 1 << FIXED_POINT_BITS.
+  static std::vector<int> makeFixedPointFilter(const std::vector<float>& f);
+
+  //! Separable filter of an 8-bit image with the fixed point filter 'f' (odd length) in both directions.
+  /*! Pixels beyond the border are clamped to the border pixel. The result
+   *  has FIXED_POINT_BITS fractional bits, i.e. an input of 255 maps to
+   *  255 << FIXED_POINT_BITS. All arithmetic is integer and the inner
+   *  loops run over contiguous rows, so that the compiler vectorizes them.
+   *  @param src first pixel of the input, rows are 'stride' bytes apart
+   *  @param tmp scratch space for the horizontally filtered rows, resized as needed
+   *  @param acc scratch space for one row of sums, resized as needed
+   *  @param dst width*height output pixels
+   */
+  static void filterFactoredCentered8(const uint8_t* src, int width, int height, size_t stride,
+                                      const std::vector<int>& f, std::vector<uint16_t>& tmp,
+                                      std::vector<uint32_t>& acc, uint16_t* dst);
 };
 
 } // namespace
@@ -15,7 +15,7 @@
 
 // interpolate points instead of using homography
 //#define INTERPOLATE
-// use stable version of homography recover (opencv, includes refinement step)
+// use stable version of homography recover (exact solve of the four correspondences)
 #define STABLE_H
 
 //! Compute 3x3 homography using Direct Linear Transform
@@ -49,8 +49,7 @@ public:
   Homography33(const std::pair<float,float> &opticalCenter);
 
 #ifdef STABLE_H
-  void setCorrespondences(const std::vector< std::pair<float,float> > &srcPts,
-                          const std::vector< std::pair<float,float> > &dstPts);
+  void setCorrespondences(const std::pair<float,float> srcPts[4], const std::pair<float,float> dstPts[4]);
 #else
   void addCorrespondence(float worldx, float worldy, float imagex, float imagey);
 #endif
@@ -70,7 +69,7 @@ private:
   Eigen::Matrix3d H;
   bool valid;
 #ifdef STABLE_H
-  std::vector< std::pair<float,float> > srcPts, dstPts;
+  std::pair<float,float> srcPts[4], dstPts[4];
 #endif
 };
 
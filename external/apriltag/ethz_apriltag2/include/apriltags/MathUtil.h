@@ -61,6 +61,24 @@ public:
     else
       return angle;
   }
+
+  //! Branch free arctan approximation, within 1e-5 rad of std::atan2 and vectorizable.
+  /*! Polynomial on the octant [0,1] (Rajan et al., "Efficient approximations
+   *  for the arctangent function"), folded out to the full circle with
+   *  selects. Returns 0 for atan2(0,0), like std::atan2.
+   */
+  static inline float atan2_approx(float y, float x) {
+    const float ax = std::fabs(x);
+    const float ay = std::fabs(y);
+    const float mx = ax > ay ? ax : ay;
+    const float mn = ax > ay ? ay : ax;
+    const float a = mn / (mx + FLT_MIN);
+    const float s = a*a;
+    float r = ((-0.0464964749f*s + 0.15931422f)*s - 0.327622764f)*s*a + a;
+    r = ay > ax ? 1.57079637f - r : r;
+    r = x < 0 ? 3.14159274f - r : r;
+    return y < 0 ? -r : r;
+  }
 	
 };
 
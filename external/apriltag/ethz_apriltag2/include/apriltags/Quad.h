@@ -21,11 +21,12 @@ class Quad {
 public:
   static const int minimumEdgeLength = 6; //!< Minimum size of a tag (in pixels) as measured along edges and diagonals
   static float const maxQuadAspectRatio; //!< Early pruning of quads with insane ratios.
+  static const int maxSearchNodes = 1024; //!< Bound on the search steps starting from one segment, caps the cost of cluttered frames.
 
   //! Constructor
   /*! (x,y) are the optical center of the camera, which is
    *   needed to correctly compute the homography. */
-  Quad(const std::vector< std::pair<float,float> >& p, const std::pair<float,float>& opticalCenter);
+  Quad(const std::pair<float,float> p[4], const std::pair<float,float>& opticalCenter);
 
   //! Interpolate given that the lower left corner of the lower left cell is at (-1,-1) and the upper right corner of the upper right cell is at (1,1).
   std::pair<float,float> interpolate(float x, float y);
@@ -34,10 +35,10 @@ public:
   std::pair<float,float> interpolate01(float x, float y);
 
   //! Points for the quad (in pixel coordinates), in counter clockwise order. These points are the intersections of segments.
-  std::vector< std::pair<float,float> > quadPoints;
+  std::pair<float,float> quadPoints[4];
 
   //! Segments composing this quad
-  std::vector<Segment*> segments;
+  Segment* segments[4];
 
   //! Total length (in pixels) of the actual perimeter observed for the quad.
   /*! This is in contrast to the geometric perimeter, some of which
@@ -54,11 +55,13 @@ public:
   /*  @param quads any discovered quads will be added to this list
    *  @param path  the segments currently part of the search
    *  @param parent the first segment in the quad
+   *  @param children the child lists of all segments, see Segment::firstChild
    *  @param depth how deep in the search are we?
+   *  @param nodesLeft search steps left, the search stops when it reaches 0
    */
-  static void search(const FloatImage& fImage, std::vector<Segment*>& path,
-                     Segment& parent, int depth, std::vector<Quad>& quads,
-                     const std::pair<float,float>& opticalCenter);
+  static void search(std::vector<Segment*>& path,
+                     Segment& parent, const std::vector<Segment*>& children, int depth, std::vector<Quad>& quads,
+                     const std::pair<float,float>& opticalCenter, int& nodesLeft);
 
 #ifdef INTERPOLATE
  private:
@@ -2,7 +2,6 @@
 #define SEGMENT_H
 
 #include <cmath>
-#include <vector>
 
 namespace AprilTags {
 
@@ -41,7 +40,9 @@ public:
   //! ID of Segment.
   int getId() const { return segmentId; }
 
-  std::vector<Segment*> children;
+  //! Segments that begin where this one ends, children[firstChild, firstChild + numChildren) of the detector's list.
+  int firstChild;
+  int numChildren;
 
 private:
   float x0, y0, x1, y1;
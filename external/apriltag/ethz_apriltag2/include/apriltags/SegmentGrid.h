@@ -0,0 +1,57 @@
+#ifndef SEGMENTGRID_H
+#define SEGMENTGRID_H
+
+#include <algorithm>
+#include <vector>
+
+#include "apriltags/Segment.h"
+
+namespace AprilTags {
+
+//! Uniform grid over the start points of segments, for finding the segments that start near a point.
+/*! Segments are bucketed by a counting sort into one flat array, so building
+ *  the grid is linear in the number of segments and cells and reuses its
+ *  storage from frame to frame. Lookups visit the same cells, in the same
+ *  order, as Gridder did.
+ */
+class SegmentGrid {
+public:
+  SegmentGrid() : cellSize(1), cols(0), rows(0), cellStart(), segmentCell(), items() {}
+
+  //! Indexes segments by their start point (x0,y0), in cells of cellSizeArg pixels covering a width x height image.
+  /*! Segments starting outside the image are not indexed. The grid points
+   *  into segments, which must not change until the next build. */
+  void build(std::vector<Segment>& segments, int width, int height, float cellSizeArg);
+
+  //! Calls f(Segment&) for every segment starting in a cell that overlaps the square of half side range around (x,y).
+  template <typename F>
+  void forEachNear(float x, float y, float range, F f) const {
+    if (items.empty())
+      return;
+
+    const int ix0 = clampCol((int) ((x - range)/cellSize));
+    const int iy0 = clampRow((int) ((y - range)/cellSize));
+    const int ix1 = clampCol((int) ((x + range)/cellSize));
+    const int iy1 = clampRow((int) ((y + range)/cellSize));
+
+    for (int iy = iy0; iy <= iy1; iy++) {
+      const int* row = &cellStart[iy*cols];
+      for (int i = row[ix0]; i < row[ix1 + 1]; i++)
+        f(*items[i]);
+    }
+  }
+
+private:
+  int clampCol(int ix) const { return std::min(cols - 1, std::max(0, ix)); }
+  int clampRow(int iy) const { return std::min(rows - 1, std::max(0, iy)); }
+
+  float cellSize;
+  int cols, rows;
+  std::vector<int> cellStart;  //!< Segments of cell c are items[cellStart[c], cellStart[c+1])
+  std::vector<int> segmentCell;  //!< Cell of every segment, -1 if outside
+  std::vector<Segment*> items;
+};
+
+} // namespace
+
+#endif
@@ -8,6 +8,7 @@
 #include "apriltags//TagDetection.h"
 #include "apriltags//TagFamily.h"
 #include "apriltags//FloatImage.h"
+#include "apriltags//TagDetectorArena.h"
 
 namespace AprilTags {
 
@@ -16,12 +17,30 @@ namespace AprilTags {
 	
         const TagFamily thisTagFamily;
 
+        //! Quads are searched for in the image decimated by this factor (1 == full resolution).
+        /*! Their edges are then refit and the tags decoded on the full
+         *  resolution image, so decimation trades the smallest detectable
+         *  tag for segmentation time, roughly quadDecimate^2 less of it.
+         */
+        int quadDecimate;
+
         //! Constructor
         // note: TagFamily is instantiated here from TagCodes
-        TagDetector(const TagCodes& tagCodes, const size_t blackBorder=2) : thisTagFamily(tagCodes, blackBorder) {}
+        TagDetector(const TagCodes& tagCodes, const size_t blackBorder=2) : thisTagFamily(tagCodes, blackBorder), quadDecimate(1) {}
 	
+        //! Detects tags in an 8-bit image, using scratch buffers private to the calling thread.
         std::vector<TagDetection> extractTags(const cv::Mat& image, int startId = 0);
 
+        //! Detects tags in an 8-bit image, using the scratch buffers of arena.
+        std::vector<TagDetection> extractTags(const cv::Mat& image, TagDetectorArena& arena, int startId = 0);
+
+        //! Same as above, replacing the contents of detections, which keeps its capacity from call to call.
+        void extractTags(const cv::Mat& image, std::vector<TagDetection>& detections, int startId = 0);
+
+        //! Same as above, replacing the contents of detections.
+        void extractTags(const cv::Mat& image, TagDetectorArena& arena, std::vector<TagDetection>& detections,
+                         int startId = 0);
+
     };
 
 } // namespace
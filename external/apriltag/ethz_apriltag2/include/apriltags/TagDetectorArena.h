@@ -0,0 +1,68 @@
+#ifndef TAGDETECTORARENA_H
+#define TAGDETECTORARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "apriltags/Edge.h"
+#include "apriltags/FloatImage.h"
+#include "apriltags/Quad.h"
+#include "apriltags/Segment.h"
+#include "apriltags/SegmentGrid.h"
+#include "apriltags/TagDetection.h"
+#include "apriltags/UnionFindSimple.h"
+#include "apriltags/XYWeight.h"
+
+namespace AprilTags {
+
+//! Scratch buffers of TagDetector::extractTags, reused from frame to frame.
+/*! Buffers only ever grow, so once an arena has seen a frame of a given
+ *  resolution, detecting in further frames of that resolution does not
+ *  allocate for them. An arena must not be used by two threads at a time.
+ */
+struct TagDetectorArena {
+  TagDetectorArena();
+
+  //! Prepares the arena for a width x height frame.
+  /*! Constant time when the frame has the size of the previous one: buffers
+   *  that are big enough are left alone and cluster membership is invalidated
+   *  by bumping a stamp rather than clearing it. A larger frame grows the
+   *  buffers, a frame of another size resizes fimTheta and fimMag.
+   */
+  void reset(int width, int height);
+
+  std::vector<uint8_t> decimated;   //!< Input image box filtered by the quad decimation factor
+  std::vector<int> decimateSums;    //!< Row of block sums of the decimation
+  std::vector<XYWeight> edgePoints; //!< Edge samples of the full resolution quad refinement
+  std::vector<uint16_t> fimSeg;     //!< Smoothed image, fixed point
+  std::vector<uint16_t> filterTmp;  //!< Horizontal pass of the separable filter
+  std::vector<uint32_t> filterAcc;  //!< Row of sums of the separable filter
+  FloatImage fimTheta;
+  FloatImage fimMag;
+
+  UnionFindSimple uf;
+  std::vector<Edge> edges;
+  std::vector<Edge> sortedEdges;
+  std::vector<float> bounds;  //!< tmin, tmax, mmin, mmax of every set
+
+  //! clusterIndex[rep] is valid iff clusterStamp[rep] == stamp. It holds the
+  //! point count of the set while counting and its write position while scattering.
+  std::vector<unsigned int> clusterStamp;
+  std::vector<int> clusterIndex;
+  unsigned int stamp;
+  std::vector<int> clusterReps;     //!< Representatives of the clusters, ascending
+  std::vector<int> clusterOffsets;  //!< Cluster i is clusterPoints[clusterOffsets[i], clusterOffsets[i+1])
+  std::vector<XYWeight> clusterPoints;
+
+  std::vector<Segment> segments;
+  std::vector<Segment*> children;  //!< Child lists of all segments, see Segment::firstChild
+  SegmentGrid segmentGrid;
+  std::vector<Quad> quads;
+  std::vector<Segment*> path;
+  std::vector<TagDetection> detections;  //!< Decoded quads, before overlapping duplicates are removed
+};
+
+} // namespace
+
+#endif
@@ -54,7 +54,10 @@ public:
   static int popCount(unsigned long long w);
 
   //! Given an observed tag with code 'rCode', try to recover the id.
-  /*  The corresponding fields of TagDetection will be filled in. */
+  /*  The corresponding fields of TagDetection will be filled in. With a
+   *  decode table, codes farther than errorRecoveryBits from every valid
+   *  code get id -1 and hammingDistance errorRecoveryBits+1.
+   */
   void decode(TagDetection& det, unsigned long long rCode) const;
 
   //! Prints the hamming distances of the tag codes.
@@ -87,6 +90,30 @@ public:
   //! The array of the codes. The id for a code is its index.
   std::vector<unsigned long long> codes;
 
+  //! Maps an observed code to the id, rotation and hamming distance it decodes to.
+  struct DecodeEntry {
+    unsigned long long code;
+    int id; //!< -1 marks an empty slot
+    unsigned char rotation;
+    unsigned char hammingDistance;
+  };
+
+  //! Open addressing hash table of every code within errorRecoveryBits of a rotated valid code.
+  /*  Rebuilt whenever errorRecoveryBits changes. Empty if it would have more
+   *  than maxDecodeTableEntries entries, decode then compares against every
+   *  code instead.
+   */
+  std::vector<DecodeEntry> decodeTable;
+  int decodeTableShift;
+  static const size_t maxDecodeTableEntries = 1 << 22;
+
+  void buildDecodeTable();
+  void addDecodeEntry(unsigned long long rCode, int id, int rotation, int hamming);
+  void addDecodeEntries(unsigned long long code, int id, int firstBit, int hamming);
+  size_t decodeSlot(unsigned long long rCode) const {
+    return (size_t) ((rCode * 0x9E3779B97F4A7C15ull) >> decodeTableShift);
+  }
+
   static const int  popCountTableShift = 12;
   static const unsigned int popCountTableSize = 1 << popCountTableShift;
   static unsigned char popCountTable[popCountTableSize];
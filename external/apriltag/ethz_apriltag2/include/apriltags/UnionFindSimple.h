@@ -6,6 +6,9 @@
 namespace AprilTags {
 
 //! Implementation of disjoint set data structure using the union-find algorithm
+/*! Sets are kept in one flat array, merged by size and compressed by path
+ *  halving, so lookups are iterative and touch few cache lines.
+ */
 class UnionFindSimple {
   //! Identifies parent ids and sizes.
   struct Data {
@@ -14,13 +17,28 @@ class UnionFindSimple {
   };
 
 public:
+  UnionFindSimple() : data() {}
+
   explicit UnionFindSimple(int maxId) : data(maxId) {
     init();
   };
+
+  //! Makes every id in [0, maxId) its own set again, reusing the allocated storage.
+  void reset(int maxId) {
+    data.resize(maxId);
+    init();
+  }
   
   int getSetSize(int thisId) { return data[getRepresentative(thisId)].size; }
 
-  int getRepresentative(int thisId);
+  //! Path halving: every visited node is pointed to its grandparent.
+  int getRepresentative(int thisId) {
+    while (data[thisId].id != thisId) {
+      data[thisId].id = data[data[thisId].id].id;
+      thisId = data[thisId].id;
+    }
+    return thisId;
+  }
 
   //! Returns the id of the merged node.
   /*  @param aId
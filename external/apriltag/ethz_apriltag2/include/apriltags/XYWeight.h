@@ -9,6 +9,8 @@ struct XYWeight {
   float y;
   float weight;
 
+  XYWeight() : x(0), y(0), weight(0) {}
+
   XYWeight(float xval, float yval, float weightval) :
     x(xval), y(yval), weight(weightval) {}
 
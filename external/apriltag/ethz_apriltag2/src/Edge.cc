@@ -7,7 +7,7 @@ namespace AprilTags {
 
 float const Edge::minMag = 0.004f;
 float const Edge::maxEdgeCost = 30.f * float(M_PI) / 180.f;
-int const Edge::WEIGHT_SCALE = 100;
+int const Edge::WEIGHT_SCALE;
 float const Edge::thetaThresh = 100;
 float const Edge::magThresh = 1200;
 
@@ -66,9 +66,25 @@ void Edge::calcEdges(float theta0, int x, int y,
   }
 }
 
-void Edge::mergeEdges(std::vector<Edge> &edges, UnionFindSimple &uf,
+void Edge::sortEdges(const std::vector<Edge> &edges, size_t nEdges, std::vector<Edge> &sorted) {
+  if (sorted.size() < nEdges)
+    sorted.resize(nEdges);
+
+  // histogram of costs, shifted by one so that the prefix sum gives the start of every bucket
+  int offsets[WEIGHT_SCALE + 2] = {0};
+  for (size_t i = 0; i < nEdges; i++)
+    ++offsets[edges[i].cost + 1];
+  for (int c = 0; c <= WEIGHT_SCALE; c++)
+    offsets[c + 1] += offsets[c];
+
+  // scatter in input order, which keeps it stable
+  for (size_t i = 0; i < nEdges; i++)
+    sorted[offsets[edges[i].cost]++] = edges[i];
+}
+
+void Edge::mergeEdges(const std::vector<Edge> &edges, size_t nEdges, UnionFindSimple &uf,
 		      float tmin[], float tmax[], float mmin[], float mmax[]) {
-  for (size_t i = 0; i < edges.size(); i++) {
+  for (size_t i = 0; i < nEdges; i++) {
     int ida = edges[i].pixelIdxA;
     int idb = edges[i].pixelIdxB;
 
@@ -21,6 +21,12 @@ FloatImage& FloatImage::operator=(const FloatImage& other) {
   return *this;
 }
 
+void FloatImage::resize(int widthArg, int heightArg) {
+  width = widthArg;
+  height = heightArg;
+  pixels.resize(widthArg*heightArg);
+}
+
 void FloatImage::decimateAvg() {
   int nWidth = width/2;
   int nHeight = height/2;
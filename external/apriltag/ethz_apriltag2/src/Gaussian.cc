@@ -1,4 +1,5 @@
 #include "apriltags/Gaussian.h"
+#include <algorithm>
 #include <iostream>
 
 namespace AprilTags {
@@ -68,4 +69,67 @@ void Gaussian::convolveSymmetricCentered(const std::vector<float>& a, unsigned i
   }
 }
 
+std::vector<int> Gaussian::makeFixedPointFilter(const std::vector<float>& f) {
+  const int one = 1 << FIXED_POINT_BITS;
+  std::vector<int> q(f.size());
+  int sum = 0;
+  for (size_t i = 0; i < f.size(); i++) {
+    q[i] = (int)std::lround(f[i] * one);
+    sum += q[i];
+  }
+  // put the rounding error on the center tap, which keeps the filter symmetric
+  q[f.size()/2] += one - sum;
+  return q;
+}
+
+void Gaussian::filterFactoredCentered8(const uint8_t* src, int width, int height, size_t stride,
+                                       const std::vector<int>& f, std::vector<uint16_t>& tmp,
+                                       std::vector<uint32_t>& acc, uint16_t* dst) {
+  const int n = (int)f.size();
+  const int r = n/2;
+  tmp.resize((size_t)width*height);
+
+  // Both passes loop over the taps outside and the pixels of a row inside,
+  // accumulating into 'acc', so that the inner loops are plain
+  // multiply-adds over contiguous memory.
+  acc.resize(width);
+
+  // horizontal, 8-bit in, FIXED_POINT_BITS fractional bits out (at most 255 << 8, fits 16 bits)
+  for (int y = 0; y < height; y++) {
+    const uint8_t* in = src + y*stride;
+    uint16_t* out = &tmp[(size_t)y*width];
+
+    std::fill(acc.begin(), acc.end(), 0);
+    for (int j = 0; j < n; j++) {
+      const uint32_t w = (uint32_t)f[j];
+      const int off = j - r;
+      for (int x = std::max(0, -off); x < std::min(width, width - off); x++)
+        acc[x] += w * in[x + off];
+      // clamped borders
+      for (int x = 0; x < std::min(width, -off); x++)
+        acc[x] += w * in[0];
+      for (int x = std::max(0, width - off); x < width; x++)
+        acc[x] += w * in[width - 1];
+    }
+    for (int x = 0; x < width; x++)
+      out[x] = (uint16_t)acc[x];
+  }
+
+  // vertical, rounded back to FIXED_POINT_BITS fractional bits
+  const uint32_t half = 1u << (FIXED_POINT_BITS - 1);
+  for (int y = 0; y < height; y++) {
+    std::fill(acc.begin(), acc.end(), half);
+    for (int j = 0; j < n; j++) {
+      const uint32_t w = (uint32_t)f[j];
+      const uint16_t* in = &tmp[(size_t)std::min(std::max(y + j - r, 0), height - 1)*width];
+      for (int x = 0; x < width; x++)
+        acc[x] += w * in[x];
+    }
+
+    uint16_t* out = dst + (size_t)y*width;
+    for (int x = 0; x < width; x++)
+      out[x] = (uint16_t)(acc[x] >> FIXED_POINT_BITS);
+  }
+}
+
 } // namespace
@@ -1,11 +1,10 @@
 //-*-c++-*-
 
+#include <algorithm>
 #include <iostream>
 
 #include <Eigen/Dense>
 
-#include <opencv2/opencv.hpp>
-
 #include "apriltags/Homography33.h"
 
 Homography33::Homography33(const std::pair<float,float> &opticalCenter) : cxy(opticalCenter), fA(), H(), valid(false) {
@@ -19,11 +18,10 @@ Eigen::Matrix3d& Homography33::getH() {
 }
 
 #ifdef STABLE_H
-void Homography33::setCorrespondences(const std::vector< std::pair<float,float> > &sPts,
-                                      const std::vector< std::pair<float,float> > &dPts) {
+void Homography33::setCorrespondences(const std::pair<float,float> sPts[4], const std::pair<float,float> dPts[4]) {
   valid = false;
-  srcPts = sPts;
-  dstPts = dPts;
+  std::copy(sPts, sPts + 4, srcPts);
+  std::copy(dPts, dPts + 4, dstPts);
 }
 #else
 void Homography33::addCorrespondence(float worldx, float worldy, float imagex, float imagey) {
@@ -163,20 +161,22 @@ void Homography33::addCorrespondence(float worldx, float worldy, float imagex, f
 void Homography33::compute() {
   if ( valid ) return;
 
-  std::vector<cv::Point2f> sPts;
-  std::vector<cv::Point2f> dPts;
-  for (int i=0; i<4; i++) {
-    sPts.push_back(cv::Point2f(srcPts[i].first, srcPts[i].second));
-  }
+  // Four correspondences determine H exactly, scaled to H(2,2) = 1 like
+  // cv::findHomography did. Fixed size, so that nothing is allocated.
+  Eigen::Matrix<double,8,8> A;
+  Eigen::Matrix<double,8,1> b;
   for (int i=0; i<4; i++) {
-    dPts.push_back(cv::Point2f(dstPts[i].first - cxy.first, dstPts[i].second - cxy.second));
-  }
-  cv::Mat homography = cv::findHomography(sPts, dPts);
-  for (int c=0; c<3; c++) {
-    for (int r=0; r<3; r++) {
-      H(r,c) = homography.at<double>(r,c);
-    }
+    const double x = srcPts[i].first, y = srcPts[i].second;
+    const double u = dstPts[i].first - cxy.first, v = dstPts[i].second - cxy.second;
+    A.row(2*i) << x, y, 1, 0, 0, 0, -x*u, -y*u;
+    A.row(2*i+1) << 0, 0, 0, x, y, 1, -x*v, -y*v;
+    b(2*i) = u;
+    b(2*i+1) = v;
   }
+  const Eigen::Matrix<double,8,1> h = A.fullPivLu().solve(b);
+  H << h(0), h(1), h(2),
+       h(3), h(4), h(5),
+       h(6), h(7), 1;
 
   valid = true;
 }
@@ -189,8 +189,9 @@ void Homography33::compute() {
     for (int j = i+1; j < 9; j++)
       fA(j,i) = fA(i,j);
 
-  Eigen::JacobiSVD<Eigen::MatrixXd> svd(fA, Eigen::ComputeFullU | Eigen::ComputeFullV);
-  Eigen::MatrixXd eigV = svd.matrixV();
+  // Fixed size, so that the decomposition stays on the stack
+  Eigen::JacobiSVD<Eigen::Matrix<double,9,9> > svd(fA, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const Eigen::Matrix<double,9,9>& eigV = svd.matrixV();
 
   for (int i = 0; i < 3; i++) {
     for (int j = 0; j < 3; j++) {
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <Eigen/Dense>
 
 #include "apriltags/FloatImage.h"
@@ -9,15 +11,13 @@
 namespace AprilTags {
 	
 const float Quad::maxQuadAspectRatio = 32;
+const int Quad::maxSearchNodes;
 
-Quad::Quad(const std::vector< std::pair<float,float> >& p, const std::pair<float,float>& opticalCenter)
-  : quadPoints(p), segments(), observedPerimeter(), homography(opticalCenter) {
+Quad::Quad(const std::pair<float,float> p[4], const std::pair<float,float>& opticalCenter)
+  : quadPoints{p[0], p[1], p[2], p[3]}, segments(), observedPerimeter(), homography(opticalCenter) {
 #ifdef STABLE_H
-  std::vector< std::pair<float,float> > srcPts;
-  srcPts.push_back(std::make_pair(-1, -1));
-  srcPts.push_back(std::make_pair( 1, -1));
-  srcPts.push_back(std::make_pair( 1,  1));
-  srcPts.push_back(std::make_pair(-1,  1));
+  static const std::pair<float,float> srcPts[4] = {
+    std::make_pair(-1.f, -1.f), std::make_pair(1.f, -1.f), std::make_pair(1.f, 1.f), std::make_pair(-1.f, 1.f)};
   homography.setCorrespondences(srcPts, p);
 #else
   homography.addCorrespondence(-1, -1, quadPoints[0].first, quadPoints[0].second);
@@ -49,10 +49,14 @@ std::pair<float,float> Quad::interpolate01(float x, float y) {
   return interpolate(2*x-1, 2*y-1);
 }
 
-void Quad::search(const FloatImage& fImage, std::vector<Segment*>& path,
-                  Segment& parent, int depth, std::vector<Quad>& quads,
-                  const std::pair<float,float>& opticalCenter) {
-  // cout << "Searching segment " << parent.getId() << ", depth=" << depth << ", #children=" << parent.children.size() << endl;
+void Quad::search(std::vector<Segment*>& path,
+                  Segment& parent, const std::vector<Segment*>& children, int depth, std::vector<Quad>& quads,
+                  const std::pair<float,float>& opticalCenter, int& nodesLeft) {
+  if (nodesLeft <= 0)
+    return;
+  nodesLeft--;
+
+  // cout << "Searching segment " << parent.getId() << ", depth=" << depth << ", #children=" << parent.numChildren << endl;
   // terminal depth occurs when we've found four segments.
   if (depth == 4) {
     // cout << "Entered terminal depth" << endl; // debug code
@@ -60,7 +64,7 @@ void Quad::search(const FloatImage& fImage, std::vector<Segment*>& path,
     // Is the first segment the same as the last segment (i.e., a loop?)
     if (path[4] == path[0]) {
       // the 4 corners of the quad as computed by the intersection of segments.
-      std::vector< std::pair<float,float> > p(4);
+      std::pair<float,float> p[4];
       float calculatedPerimeter = 0;
       bool bad = false;
       for (int i = 0; i < 4; i++) {
@@ -125,7 +129,7 @@ void Quad::search(const FloatImage& fImage, std::vector<Segment*>& path,
 
       if (!bad) {
 	Quad q(p, opticalCenter);
-	q.segments=path;
+	std::copy(path.begin(), path.begin() + 4, q.segments);
 	q.observedPerimeter = calculatedPerimeter;
 	quads.push_back(q);
       }
@@ -137,8 +141,8 @@ void Quad::search(const FloatImage& fImage, std::vector<Segment*>& path,
   //cout << "depth: " << depth << endl;
 
   // Not terminal depth. Recurse on any children that obey the correct handedness.
-  for (unsigned int i = 0; i < parent.children.size(); i++) {
-    Segment &child = *parent.children[i];
+  for (int i = 0; i < parent.numChildren; i++) {
+    Segment &child = *children[parent.firstChild + i];
     //    cout << "  Child " << child.getId() << ":  ";
     // (handedness was checked when we created the children)
     
@@ -152,7 +156,7 @@ void Quad::search(const FloatImage& fImage, std::vector<Segment*>& path,
       continue;
     }
     path[depth+1] = &child;
-    search(fImage, path, child, depth+1, quads, opticalCenter);
+    search(path, child, children, depth+1, quads, opticalCenter, nodesLeft);
   }
 }
 
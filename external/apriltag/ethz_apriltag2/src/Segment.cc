@@ -6,7 +6,7 @@ namespace AprilTags {
 const float Segment::minimumLineLength = 4;
 
 Segment::Segment() 
-  : children(), x0(0), y0(0), x1(0), y1(0), theta(0), length(0), segmentId(++idCounter) {}
+  : firstChild(0), numChildren(0), x0(0), y0(0), x1(0), y1(0), theta(0), length(0), segmentId(++idCounter) {}
 
 float Segment::segmentLength() {
   return std::sqrt((x1-x0)*(x1-x0) + (y1-y0)*(y1-y0));
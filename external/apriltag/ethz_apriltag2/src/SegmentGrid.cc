@@ -0,0 +1,44 @@
+#include "apriltags/SegmentGrid.h"
+
+namespace AprilTags {
+
+void SegmentGrid::build(std::vector<Segment>& segments, int width, int height, float cellSizeArg) {
+  cellSize = cellSizeArg;
+  cols = (int) (width/cellSize + 1);
+  rows = (int) (height/cellSize + 1);
+
+  const int numCells = cols*rows;
+  cellStart.assign(numCells + 1, 0);
+  segmentCell.resize(segments.size());
+
+  // count
+  for (size_t i = 0; i < segments.size(); i++) {
+    const int ix = (int) (segments[i].getX0()/cellSize);
+    const int iy = (int) (segments[i].getY0()/cellSize);
+    if (ix >= 0 && iy >= 0 && ix < cols && iy < rows) {
+      segmentCell[i] = iy*cols + ix;
+      cellStart[segmentCell[i] + 1]++;
+    } else {
+      segmentCell[i] = -1;
+    }
+  }
+
+  for (int c = 0; c < numCells; c++)
+    cellStart[c + 1] += cellStart[c];
+
+  // scatter, last added first within a cell
+  items.resize(cellStart[numCells]);
+  std::vector<int>::iterator pos = cellStart.begin();
+  for (size_t i = segments.size(); i-- > 0;) {
+    const int c = segmentCell[i];
+    if (c >= 0)
+      items[pos[c]++] = &segments[i];
+  }
+
+  // the scatter advanced every start to the start of the next cell
+  for (int c = numCells; c > 0; c--)
+    cellStart[c] = cellStart[c - 1];
+  cellStart[0] = 0;
+}
+
+} // namespace
@@ -2,7 +2,6 @@
 #include <climits>
 #include <cmath>
 #include <iostream>
-#include <map>
 #include <vector>
 
 #include <Eigen/Dense>
@@ -13,11 +12,11 @@
 #include "apriltags/GLineSegment2D.h"
 #include "apriltags/Gaussian.h"
 #include "apriltags/GrayModel.h"
-#include "apriltags/Gridder.h"
 #include "apriltags/Homography33.h"
 #include "apriltags/MathUtil.h"
 #include "apriltags/Quad.h"
 #include "apriltags/Segment.h"
+#include "apriltags/SegmentGrid.h"
 #include "apriltags/TagFamily.h"
 #include "apriltags/UnionFindSimple.h"
 #include "apriltags/XYWeight.h"
@@ -35,93 +34,186 @@ using namespace std;
 
 namespace AprilTags {
 
-    std::vector<TagDetection> TagDetector::extractTags(const cv::Mat &image, int startId) {
-        // convert to internal AprilTags image (todo: slow, change internally to
-        // OpenCV)
-        int width = image.cols;
-        int height = image.rows;
-        AprilTags::FloatImage fimOrig(width, height);
-        int i = 0;
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                fimOrig.set(x, y, image.data[i] / 255.);
-                i++;
+    namespace {
+        //! Averages d x d blocks of image into out, a width/d x height/d image.
+        void decimateImage(const cv::Mat &image, int d, std::vector<uint8_t> &out, std::vector<int> &sums) {
+            const int outWidth = image.cols / d;
+            const int outHeight = image.rows / d;
+            const int area = d * d;
+            out.resize(outWidth * outHeight);
+
+            sums.resize(outWidth);
+            for (int y = 0; y < outHeight; y++) {
+                std::fill(sums.begin(), sums.end(), 0);
+                for (int dy = 0; dy < d; dy++) {
+                    const uint8_t *row = image.ptr<uint8_t>(y * d + dy);
+                    for (int x = 0; x < outWidth; x++) {
+                        for (int dx = 0; dx < d; dx++) sums[x] += row[x * d + dx];
+                    }
+                }
+                uint8_t *outRow = &out[y * outWidth];
+                for (int x = 0; x < outWidth; x++) outRow[x] = (uint8_t)((sums[x] + area / 2) / area);
             }
         }
-        std::pair<int, int> opticalCenter(width / 2, height / 2);
 
-#ifdef DEBUG_APRIL
-#if 0
-  { // debug - write
-    int height_ = fimOrig.getHeight();
-    int width_  = fimOrig.getWidth();
-    cv::Mat image(height_, width_, CV_8UC3);
-    {
-      for (int y=0; y<height_; y++) {
-        for (int x=0; x<width_; x++) {
-          cv::Vec3b v;
-          //        float vf = fimMag.get(x,y);
-          float vf = fimOrig.get(x,y);
-          int val = (int)(vf * 255.);
-          if ((val & 0xffff00) != 0) {printf("problem... %i\n", val);}
-          for (int k=0; k<3; k++) {
-            v(k) = val;
-          }
-          image.at<cv::Vec3b>(y, x) = v;
+        //! Bilinear interpolation of image at (x,y), in [0,1]. The point must be inside the image.
+        inline float sampleImage(const cv::Mat &image, float x, float y) {
+            const int x0 = (int)x;
+            const int y0 = (int)y;
+            const float fx = x - x0;
+            const float fy = y - y0;
+            const uint8_t *r0 = image.ptr<uint8_t>(y0);
+            const uint8_t *r1 = image.ptr<uint8_t>(y0 + 1);
+            const float top = r0[x0] + fx * (r0[x0 + 1] - r0[x0]);
+            const float bottom = r1[x0] + fx * (r1[x0 + 1] - r1[x0]);
+            return (top + fy * (bottom - top)) * (1.f / 255.f);
         }
-      }
-    }
-    imwrite("out.bmp", image);
-  }
-#endif
-#if 0
-  FloatImage fimOrig = fimOrig_;
-  { // debug - read
-
-    cv::Mat image = cv::imread("test.bmp");
-    int height_ = fimOrig.getHeight();
-    int width_  = fimOrig.getWidth();
-    {
-      for (int y=0; y<height_; y++) {
-        for (int x=0; x<width_; x++) {
-          cv::Vec3b v = image.at<cv::Vec3b>(y,x);
-          float val = (float)v(0)/255.;
-          fimOrig.set(x,y,val);
+
+        //! Refits the edges of a quad found in the decimated image on the full resolution image.
+        /*! Every edge is sampled at regular steps. At each sample the dark
+         *  to light transition along the outward normal is searched for
+         *  within +-range pixels, the sample votes for the centroid of the
+         *  positive gradient, weighted by its strength. The corners become
+         *  the intersections of the lines fit to the votes. Returns false,
+         *  leaving p as it is, when an edge has too little support.
+         */
+        bool refineQuadEdges(const cv::Mat &image, std::pair<float, float> p[4], float range,
+                             std::vector<XYWeight> &points) {
+            const float step = 0.25f;
+
+            // Lines are fit relative to the center of the quad, for float precision
+            float cx = 0, cy = 0;
+            for (int i = 0; i < 4; i++) {
+                cx += 0.25f * p[i].first;
+                cy += 0.25f * p[i].second;
+            }
+
+            GLine2D lines[4];
+            for (int i = 0; i < 4; i++) {
+                const float x0 = p[i].first - cx, y0 = p[i].second - cy;
+                const float x1 = p[(i + 1) % 4].first - cx, y1 = p[(i + 1) % 4].second - cy;
+                const float length = std::sqrt(MathUtil::square(x1 - x0) + MathUtil::square(y1 - y0));
+                if (length < 1) return false;
+
+                // Unit normal pointing away from the center, from black border to white background
+                float nx = (y1 - y0) / length, ny = -(x1 - x0) / length;
+                if (nx * (x0 + x1) + ny * (y0 + y1) < 0) {
+                    nx = -nx;
+                    ny = -ny;
+                }
+
+                // One sample per pixel, away from the corners where the other edges interfere
+                const int nSamples = std::max(2, (int)(0.8f * length));
+                points.clear();
+                for (int k = 0; k < nSamples; k++) {
+                    const float a = 0.1f + 0.8f * (k + 0.5f) / nSamples;
+                    const float ex = x0 + a * (x1 - x0) + cx, ey = y0 + a * (y1 - y0) + cy;
+
+                    // The search must stay inside the image for the bilinear lookups
+                    const float reach = range + 1;
+                    if (std::min(ex - reach * std::fabs(nx), ey - reach * std::fabs(ny)) < 0 ||
+                        ex + reach * std::fabs(nx) >= image.cols - 1 || ey + reach * std::fabs(ny) >= image.rows - 1)
+                        continue;
+
+                    float sumW = 0, sumWT = 0;
+                    for (float t = -range; t <= range; t += step) {
+                        const float g = sampleImage(image, ex + (t + 0.5f) * nx, ey + (t + 0.5f) * ny) -
+                                        sampleImage(image, ex + (t - 0.5f) * nx, ey + (t - 0.5f) * ny);
+                        if (g <= 0) continue;
+                        sumW += g * g;
+                        sumWT += g * g * t;
+                    }
+                    if (sumW <= 0) continue;
+
+                    const float t = sumWT / sumW;
+                    points.push_back(XYWeight(ex - cx + t * nx, ey - cy + t * ny, sumW));
+                }
+
+                if (points.size() < 2 || points.size() < size_t(nSamples / 2)) return false;
+                lines[i] = GLine2D::lsqFitXYW(points.data(), points.size());
+            }
+
+            // Corner i is where edge i-1 meets edge i, it can only move by the decimation error
+            std::pair<float, float> refined[4];
+            for (int i = 0; i < 4; i++) {
+                std::pair<float, float> c = lines[(i + 3) % 4].intersectionWith(lines[i]);
+                c.first += cx;
+                c.second += cy;
+                if (MathUtil::distance2D(c, p[i]) > 2 * range) return false;
+                refined[i] = c;
+            }
+            std::copy(refined, refined + 4, p);
+            return true;
+        }
+    }  // namespace
+
+    namespace {
+        // The detector is shared by all threads detecting with the same grid
+        TagDetectorArena &threadArena() {
+            static thread_local TagDetectorArena arena;
+            return arena;
         }
-      }
+    }  // namespace
+
+    std::vector<TagDetection> TagDetector::extractTags(const cv::Mat &image, int startId) {
+        return extractTags(image, threadArena(), startId);
     }
-  }
-#endif
-#endif
 
-        //================================================================
-        // Step one: preprocess image (convert to grayscale) and low pass if necessary
+    std::vector<TagDetection> TagDetector::extractTags(const cv::Mat &image, TagDetectorArena &arena, int startId) {
+        std::vector<TagDetection> detections;
+        extractTags(image, arena, detections, startId);
+        return detections;
+    }
+
+    void TagDetector::extractTags(const cv::Mat &image, std::vector<TagDetection> &detections, int startId) {
+        extractTags(image, threadArena(), detections, startId);
+    }
 
-        FloatImage fim = fimOrig;
+    void TagDetector::extractTags(const cv::Mat &image, TagDetectorArena &arena,
+                                  std::vector<TagDetection> &goodDetections, int startId) {
+        // The 8-bit input is used as is. Smoothing is done in fixed point and
+        // bits are sampled straight from the input, so there are no float
+        // copies of the image.
+        const int imageWidth = image.cols;
+        const int imageHeight = image.rows;
+        std::pair<int, int> imageCenter(imageWidth / 2, imageHeight / 2);
+
+        // Steps one to seven run on the decimated image, if any. Images too
+        // small to hold a tag after decimation are searched at full resolution.
+        int decimate = std::max(1, quadDecimate);
+        if (std::min(imageWidth, imageHeight) / decimate < 2 * Quad::minimumEdgeLength) decimate = 1;
+
+        const uint8_t *segPixels = image.ptr<uint8_t>(0);
+        size_t segStride = image.step;
+        if (decimate > 1) {
+            decimateImage(image, decimate, arena.decimated, arena.decimateSums);
+            segPixels = arena.decimated.data();
+            segStride = imageWidth / decimate;
+        }
+        const int width = imageWidth / decimate;
+        const int height = imageHeight / decimate;
+        std::pair<int, int> opticalCenter(width / 2, height / 2);
 
-        //! Gaussian smoothing kernel applied to image (0 == no filter).
-        /*! Used when sampling bits. Filtering is a good idea in cases
-   * where A) a cheap camera is introducing artifical sharpening, B)
-   * the bayer pattern is creating artifcats, C) the sensor is very
-   * noisy and/or has hot/cold pixels. However, filtering makes it
-   * harder to decode very small tags. Reasonable values are 0, or
-   * [0.8, 1.5].
-   */
-        float sigma = 0;
+        arena.reset(width, height);
+
+        //================================================================
+        // Step one: low pass the image for segmentation.
 
         //! Gaussian smoothing kernel applied to image (0 == no filter).
         /*! Used when detecting the outline of the box. It is almost always
    * useful to have some filtering, since the loss of small details
-   * won't hurt. Recommended value = 0.8. The case where sigma ==
-   * segsigma has been optimized to avoid a redundant filter
-   * operation.
+   * won't hurt. Recommended value = 0.8. Bits are always sampled from
+   * the unfiltered image.
    */
         float segSigma = 0.8f;
 
-        if (sigma > 0) {
-            int filtsz = ((int)max(3.0f, 3 * sigma)) | 1;
-            std::vector<float> filt = Gaussian::makeGaussianFilter(sigma, filtsz);
-            fim.filterFactoredCentered(filt, filt);
+        // Smoothed image with Gaussian::FIXED_POINT_BITS fractional bits
+        vector<uint16_t> &fimSeg = arena.fimSeg;
+        {
+            static const std::vector<int> filt = Gaussian::makeFixedPointFilter(
+                    Gaussian::makeGaussianFilter(segSigma, segSigma > 0 ? ((int)max(3.0f, 3 * segSigma)) | 1 : 1));
+            Gaussian::filterFactoredCentered8(segPixels, width, height, segStride, filt,
+                                              arena.filterTmp, arena.filterAcc, fimSeg.data());
         }
 
         //================================================================
@@ -130,55 +222,48 @@ namespace AprilTags {
         // break up segments, causing us to miss Quads. It is useful to do a Gaussian
         // low pass on this step even if we don't want it for encoding.
 
-        FloatImage fimSeg;
-        if (segSigma > 0) {
-            if (segSigma == sigma) {
-                fimSeg = fim;
-            } else {
-                // blur anew
-                int filtsz = ((int)max(3.0f, 3 * segSigma)) | 1;
-                std::vector<float> filt = Gaussian::makeGaussianFilter(segSigma, filtsz);
-                fimSeg = fimOrig;
-                fimSeg.filterFactoredCentered(filt, filt);
-            }
-        } else {
-            fimSeg = fimOrig;
-        }
-
-        FloatImage fimTheta(fimSeg.getWidth(), fimSeg.getHeight());
-        FloatImage fimMag(fimSeg.getWidth(), fimSeg.getHeight());
-
-        for (int y = 1; y < fimSeg.getHeight() - 1; y++) {
-            for (int x = 1; x < fimSeg.getWidth() - 1; x++) {
-                float Ix = fimSeg.get(x + 1, y) - fimSeg.get(x - 1, y);
-                float Iy = fimSeg.get(x, y + 1) - fimSeg.get(x, y - 1);
-
-                float mag = Ix * Ix + Iy * Iy;
-#if 0  // kaess: fast version, but maybe less accurate?
-      float theta = MathUtil::fast_atan2(Iy, Ix);
-#else
-                float theta = atan2(Iy, Ix);
-#endif
+        FloatImage &fimTheta = arena.fimTheta;
+        FloatImage &fimMag = arena.fimMag;
 
-                fimTheta.set(x, y, theta);
-                fimMag.set(x, y, mag);
+        {
+            // Magnitude in units of the [0,1] intensity range, so that Edge::minMag keeps its meaning
+            const float magScale = 1.f / (255.f * 255.f * (1 << (2 * Gaussian::FIXED_POINT_BITS)));
+
+            float *thetaPixels = fimTheta.getFloatImagePixels().data();
+            float *magPixels = fimMag.getFloatImagePixels().data();
+
+            // The buffers are reused, borders have no gradient
+            std::fill(magPixels, magPixels + width, 0.f);
+            std::fill(magPixels + (height - 1) * width, magPixels + height * width, 0.f);
+
+            for (int y = 1; y < height - 1; y++) {
+                const uint16_t *r0 = &fimSeg[(y - 1) * width];
+                const uint16_t *r1 = &fimSeg[y * width];
+                const uint16_t *r2 = &fimSeg[(y + 1) * width];
+                float *theta = thetaPixels + y * width;
+                float *mag = magPixels + y * width;
+                mag[0] = mag[width - 1] = 0.f;
+
+                // Branch free, vectorized by the compiler
+                for (int x = 1; x < width - 1; x++) {
+                    const float Ix = (float)((int)r1[x + 1] - (int)r1[x - 1]);
+                    const float Iy = (float)((int)r2[x] - (int)r0[x]);
+
+                    mag[x] = (Ix * Ix + Iy * Iy) * magScale;
+                    theta[x] = MathUtil::atan2_approx(Iy, Ix);
+                }
             }
         }
 
 #ifdef DEBUG_APRIL
-        int height_ = fimSeg.getHeight();
-        int width_ = fimSeg.getWidth();
+        int height_ = imageHeight;
+        int width_ = imageWidth;
         cv::Mat dbgImage(height_, width_, CV_8UC3);
         {
             for (int y = 0; y < height_; y++) {
                 for (int x = 0; x < width_; x++) {
                     cv::Vec3b v;
-                    //        float vf = fimMag.get(x,y);
-                    float vf = fimOrig.get(x, y);
-                    int val = (int)(vf * 255.);
-                    if ((val & 0xffff00) != 0) {
-                        printf("problem... %i\n", val);
-                    }
+                    int val = image.ptr<uint8_t>(y)[x];
                     for (int k = 0; k < 3; k++) {
                         v(k) = val;
                     }
@@ -192,22 +277,17 @@ namespace AprilTags {
         // Step three. Extract edges by grouping pixels with similar
         // thetas together. This is a greedy algorithm: we start with
         // the most similar pixels.  We use 4-connectivity.
-        UnionFindSimple uf(fimSeg.getWidth() * fimSeg.getHeight());
+        UnionFindSimple &uf = arena.uf;
+        uf.reset(width * height);
 
-        vector<Edge> edges(width * height * 4);
+        vector<Edge> &edges = arena.edges;
         size_t nEdges = 0;
 
         // Bounds on the thetas assigned to this group. Note that because
         // theta is periodic, these are defined such that the average
         // value is contained *within* the interval.
-        {  // limit scope of storage
-            /* Previously all this was on the stack, but this is 1.2MB for 320x240
-      * images
-      * That's already a problem for OS X (default 512KB thread stack size),
-      * could be a problem elsewhere for bigger images... so store on heap */
-            vector<float> storage(
-                    width * height *
-                    4);  // do all the memory in one big block, exception safe
+        {
+            vector<float> &storage = arena.bounds;
             float *tmin = &storage[width * height * 0];
             float *tmax = &storage[width * height * 1];
             float *mmin = &storage[width * height * 2];
@@ -232,9 +312,8 @@ namespace AprilTags {
                 }
             }
 
-            edges.resize(nEdges);
-            std::stable_sort(edges.begin(), edges.end());
-            Edge::mergeEdges(edges, uf, tmin, tmax, mmin, mmax);
+            Edge::sortEdges(edges, nEdges, arena.sortedEdges);
+            Edge::mergeEdges(arena.sortedEdges, nEdges, uf, tmin, tmax, mmin, mmax);
         }
 
         //================================================================
@@ -242,33 +321,64 @@ namespace AprilTags {
         // cluster.
         // We will soon fit lines (segments) to these points.
 
-        map<int, vector<XYWeight> > clusters;
-        for (int y = 0; y + 1 < fimSeg.getHeight(); y++) {
-            for (int x = 0; x + 1 < fimSeg.getWidth(); x++) {
-                if (uf.getSetSize(y * fimSeg.getWidth() + x) <
-                    Segment::minimumSegmentSize)
+        // The points of all clusters go into one buffer, in two passes: count
+        // the points of every cluster, then scatter them to their offsets.
+        const unsigned int stamp = arena.stamp;
+        vector<unsigned int> &clusterStamp = arena.clusterStamp;
+        vector<int> &clusterIndex = arena.clusterIndex;
+        vector<int> &clusterReps = arena.clusterReps;
+        vector<int> &clusterOffsets = arena.clusterOffsets;
+        vector<XYWeight> &clusterPoints = arena.clusterPoints;
+
+        for (int y = 0; y + 1 < height; y++) {
+            for (int x = 0; x + 1 < width; x++) {
+                int rep = uf.getRepresentative(y * width + x);
+                if (uf.getSetSize(rep) < Segment::minimumSegmentSize)
                     continue;
 
-                int rep = (int)uf.getRepresentative(y * fimSeg.getWidth() + x);
-
-                map<int, vector<XYWeight> >::iterator it = clusters.find(rep);
-                if (it == clusters.end()) {
-                    clusters[rep] = vector<XYWeight>();
-                    it = clusters.find(rep);
+                if (clusterStamp[rep] != stamp) {
+                    clusterStamp[rep] = stamp;
+                    clusterIndex[rep] = 0;
+                    clusterReps.push_back(rep);
                 }
-                vector<XYWeight> &points = it->second;
-                points.push_back(XYWeight(x, y, fimMag.get(x, y)));
+                clusterIndex[rep]++;
+            }
+        }
+
+        // Segments are fit in order of the cluster representatives
+        std::sort(clusterReps.begin(), clusterReps.end());
+
+        clusterOffsets.resize(clusterReps.size() + 1);
+        int numPoints = 0;
+        for (size_t ci = 0; ci < clusterReps.size(); ci++) {
+            clusterOffsets[ci] = numPoints;
+            const int count = clusterIndex[clusterReps[ci]];
+            clusterIndex[clusterReps[ci]] = numPoints;
+            numPoints += count;
+        }
+        clusterOffsets[clusterReps.size()] = numPoints;
+
+        if (clusterPoints.size() < size_t(numPoints))
+            clusterPoints.resize(numPoints);
+
+        for (int y = 0; y + 1 < height; y++) {
+            for (int x = 0; x + 1 < width; x++) {
+                // The first pass left the paths short, this is about one more lookup per pixel
+                int rep = uf.getRepresentative(y * width + x);
+                if (clusterStamp[rep] != stamp)
+                    continue;
+
+                clusterPoints[clusterIndex[rep]++] = XYWeight(x, y, fimMag.get(x, y));
             }
         }
 
         //================================================================
         // Step five: Loop over the clusters, fitting lines (which we call Segments).
-        std::vector<Segment> segments;  // used in Step six
-        std::map<int, std::vector<XYWeight> >::const_iterator clustersItr;
-        for (clustersItr = clusters.begin(); clustersItr != clusters.end();
-             clustersItr++) {
-            std::vector<XYWeight> points = clustersItr->second;
-            GLineSegment2D gseg = GLineSegment2D::lsqFitXYW(points);
+        std::vector<Segment> &segments = arena.segments;  // used in Step six
+        for (size_t ci = 0; ci < clusterReps.size(); ci++) {
+            const XYWeight *points = &clusterPoints[clusterOffsets[ci]];
+            const int nPoints = clusterOffsets[ci + 1] - clusterOffsets[ci];
+            GLineSegment2D gseg = GLineSegment2D::lsqFitXYW(points, nPoints);
 
             // filter short lines
             float length = MathUtil::distance2D(gseg.getP0(), gseg.getP1());
@@ -291,8 +401,8 @@ namespace AprilTags {
             // could probably sample just one point!
 
             float flip = 0, noflip = 0;
-            for (unsigned int i = 0; i < points.size(); i++) {
-                XYWeight xyw = points[i];
+            for (int i = 0; i < nPoints; i++) {
+                const XYWeight &xyw = points[i];
 
                 float theta = fimTheta.get((int)xyw.x, (int)xyw.y);
                 float mag = fimMag.get((int)xyw.x, (int)xyw.y);
@@ -344,35 +454,28 @@ namespace AprilTags {
 
         // Step six: For each segment, find segments that begin where this segment
         // ends.
-        // (We will chain segments together next...) The gridder accelerates the
-        // search by
-        // building (essentially) a 2D hash table.
-        Gridder<Segment> gridder(0, 0, width, height, 10);
-
-        // add every segment to the hash table according to the position of the
-        // segment's
-        // first point. Remember that the first point has a specific meaning due to
-        // our
-        // left-hand rule above.
-        for (unsigned int i = 0; i < segments.size(); i++) {
-            gridder.add(segments[i].getX0(), segments[i].getY0(), &segments[i]);
-        }
+        // (We will chain segments together next...) A uniform grid over the
+        // segments' first points accelerates the search. Remember that the first
+        // point has a specific meaning due to our left-hand rule above.
+        SegmentGrid &grid = arena.segmentGrid;
+        grid.build(segments, width, height, 10);
 
         // Now, find child segments that begin where each parent segment ends.
+        // The children of a segment are contiguous in one list shared by all.
+        vector<Segment *> &children = arena.children;
         for (unsigned i = 0; i < segments.size(); i++) {
             Segment &parentseg = segments[i];
+            parentseg.firstChild = (int)children.size();
+            parentseg.numChildren = 0;
 
             // compute length of the line segment
             GLine2D parentLine(
                     std::pair<float, float>(parentseg.getX0(), parentseg.getY0()),
                     std::pair<float, float>(parentseg.getX1(), parentseg.getY1()));
 
-            Gridder<Segment>::iterator iter = gridder.find(
-                    parentseg.getX1(), parentseg.getY1(), 0.5f * parentseg.getLength());
-            while (iter.hasNext()) {
-                Segment &child = iter.next();
+            grid.forEachNear(parentseg.getX1(), parentseg.getY1(), 0.5f * parentseg.getLength(), [&](Segment &child) {
                 if (MathUtil::mod2pi(child.getTheta() - parentseg.getTheta()) > 0) {
-                    continue;
+                    return;
                 }
 
                 // compute intersection of points
@@ -381,7 +484,7 @@ namespace AprilTags {
 
                 std::pair<float, float> p = parentLine.intersectionWith(childLine);
                 if (p.first == -1) {
-                    continue;
+                    return;
                 }
 
                 float parentDist = MathUtil::distance2D(
@@ -391,24 +494,48 @@ namespace AprilTags {
 
                 if (max(parentDist, childDist) > parentseg.getLength()) {
                     // cout << "intersection too far" << endl;
-                    continue;
+                    return;
                 }
 
                 // everything's OK, this child is a reasonable successor.
-                parentseg.children.push_back(&child);
-            }
+                children.push_back(&child);
+                parentseg.numChildren++;
+            });
         }
 
         //================================================================
         // Step seven: Search all connected segments to see if any form a loop of
         // length 4.
         // Add those to the quads list.
-        vector<Quad> quads;
+        vector<Quad> &quads = arena.quads;
 
-        vector<Segment *> tmp(5);
+        vector<Segment *> &tmp = arena.path;
         for (unsigned int i = 0; i < segments.size(); i++) {
             tmp[0] = &segments[i];
-            Quad::search(fimOrig, tmp, segments[i], 0, quads, opticalCenter);
+            int nodesLeft = Quad::maxSearchNodes;
+            Quad::search(tmp, segments[i], children, 0, quads, opticalCenter, nodesLeft);
+        }
+
+        // Back to full resolution: a decimated pixel covers a decimate x
+        // decimate block, its center maps to the center of the block. The
+        // edges are then refit on the full image, to the precision a full
+        // resolution search would have found them with.
+        if (decimate > 1) {
+            const float offset = 0.5f * (decimate - 1);
+            const float range = decimate + 1.f;
+            for (unsigned int qi = 0; qi < quads.size(); qi++) {
+                std::pair<float, float> p[4];
+                for (int i = 0; i < 4; i++) {
+                    p[i].first = quads[qi].quadPoints[i].first * decimate + offset;
+                    p[i].second = quads[qi].quadPoints[i].second * decimate + offset;
+                }
+                refineQuadEdges(image, p, range, arena.edgePoints);
+
+                Quad quad(p, imageCenter);
+                std::copy(quads[qi].segments, quads[qi].segments + 4, quad.segments);
+                quad.observedPerimeter = quads[qi].observedPerimeter * decimate;
+                quads[qi] = quad;
+            }
         }
 
 #ifdef DEBUG_APRIL
@@ -450,7 +577,7 @@ namespace AprilTags {
         // threshold color to decide between 0 and 1. Then, we read off the
         // bits and see if they make sense.
 
-        std::vector<TagDetection> detections;
+        std::vector<TagDetection> &detections = arena.detections;
 
         for (unsigned int qi = 0; qi < quads.size(); qi++) {
             Quad &quad = quads[qi];
@@ -466,8 +593,8 @@ namespace AprilTags {
                     std::pair<float, float> pxy = quad.interpolate01(x, y);
                     int irx = (int)(pxy.first + 0.5);
                     int iry = (int)(pxy.second + 0.5);
-                    if (irx < 0 || irx >= width || iry < 0 || iry >= height) continue;
-                    float v = fim.get(irx, iry);
+                    if (irx < 0 || irx >= imageWidth || iry < 0 || iry >= imageHeight) continue;
+                    float v = image.ptr<uint8_t>(iry)[irx] * (1.f / 255.f);
                     if (iy == -1 || iy == dd || ix == -1 || ix == dd)
                         whiteModel.addObservation(x, y, v);
                     else if (iy == 0 || iy == (dd - 1) || ix == 0 || ix == (dd - 1))
@@ -484,7 +611,7 @@ namespace AprilTags {
                     std::pair<float, float> pxy = quad.interpolate01(x, y);
                     int irx = (int)(pxy.first + 0.5);
                     int iry = (int)(pxy.second + 0.5);
-                    if (irx < 0 || irx >= width || iry < 0 || iry >= height) {
+                    if (irx < 0 || irx >= imageWidth || iry < 0 || iry >= imageHeight) {
                         // cout << "*** bad:  irx=" << irx << "  iry=" << iry << endl;
                         bad = true;
                         continue;
@@ -492,7 +619,7 @@ namespace AprilTags {
                     float threshold =
                             (blackModel.interpolate(x, y) + whiteModel.interpolate(x, y)) *
                             0.5f;
-                    float v = fim.get(irx, iry);
+                    float v = image.ptr<uint8_t>(iry)[irx] * (1.f / 255.f);
                     tagCode = tagCode << 1;
                     if (v > threshold) tagCode |= 1;
 #ifdef DEBUG_APRIL
@@ -566,7 +693,7 @@ namespace AprilTags {
         // keep the one with the lowest error, and if the error is the same,
         // the one with the greatest observed perimeter.
 
-        std::vector<TagDetection> goodDetections;
+        goodDetections.clear();
 
         // NOTE: allow multiple non-overlapping detections of the same target.
 
@@ -614,8 +741,6 @@ namespace AprilTags {
             if (detection.id < 0)
                 throw std::runtime_error("Id smaller than 0 detected, impossible");
         }
-
-        return goodDetections;
     }
 
 }  // namespace
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "apriltags/TagDetectorArena.h"
+
+#include <algorithm>
+
+namespace AprilTags {
+
+TagDetectorArena::TagDetectorArena()
+  : decimated(), decimateSums(), edgePoints(), fimSeg(), filterTmp(), filterAcc(), fimTheta(), fimMag(), uf(),
+    edges(), sortedEdges(), bounds(), clusterStamp(), clusterIndex(), stamp(0), clusterReps(), clusterOffsets(),
+    clusterPoints(), segments(), children(), segmentGrid(), quads(), path(5), detections() {}
+
+void TagDetectorArena::reset(int width, int height) {
+  const size_t n = (size_t)width * height;
+
+  // Per pixel buffers are indexed by the frame width and only grow, stale
+  // entries beyond a smaller frame are never read
+  if (fimSeg.size() < n)
+    fimSeg.resize(n);
+  if (fimTheta.getWidth() != width || fimTheta.getHeight() != height) {
+    fimTheta.resize(width, height);
+    fimMag.resize(width, height);
+  }
+  if (edges.size() < n * 4)
+    edges.resize(n * 4);
+  if (bounds.size() < n * 4)
+    bounds.resize(n * 4);
+
+  // New entries start at stamp 0, which never matches a current stamp
+  if (clusterStamp.size() < n) {
+    clusterStamp.resize(n, 0);
+    clusterIndex.resize(n);
+  }
+  if (++stamp == 0) {
+    // wrapped around, old stamps could match again
+    std::fill(clusterStamp.begin(), clusterStamp.end(), 0);
+    stamp = 1;
+  }
+  clusterReps.clear();
+  clusterOffsets.clear();
+
+  segments.clear();
+  children.clear();
+  quads.clear();
+  detections.clear();
+}
+
+} // namespace
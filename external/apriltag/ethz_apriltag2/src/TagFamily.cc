@@ -28,18 +28,89 @@ namespace AprilTags {
 TagFamily::TagFamily(const TagCodes& tagCodes, const size_t blackBorder)
   : blackBorder(blackBorder), bits(tagCodes.bits), dimension((int)std::sqrt((float)bits)),
     minimumHammingDistance(tagCodes.minHammingDistance),
-    errorRecoveryBits(1), codes() {
+    errorRecoveryBits(1), codes(), decodeTable(), decodeTableShift(64) {
   if ( bits != dimension*dimension )
     cerr << "Error: TagFamily constructor called with bits=" << bits << "; must be a square number!" << endl;
   codes = tagCodes.codes;
+  buildDecodeTable();
 }
 
 void TagFamily::setErrorRecoveryBits(int b) {
   errorRecoveryBits = b;
+  buildDecodeTable();
 }
 
 void TagFamily::setErrorRecoveryFraction(float v) {
   errorRecoveryBits = (int) (((int) (minimumHammingDistance-1)/2)*v);
+  buildDecodeTable();
+}
+
+void TagFamily::buildDecodeTable() {
+  decodeTable.clear();
+
+  // every code, rotation and set of up to errorRecoveryBits flipped bits
+  double numEntries = 0;
+  double numFlips = 1;
+  for (int k = 0; k <= errorRecoveryBits && k <= bits; k++) {
+    numEntries += numFlips;
+    numFlips = numFlips * (bits - k) / (k + 1);
+  }
+  numEntries *= 4.0 * codes.size();
+  if (errorRecoveryBits < 0 || numEntries > maxDecodeTableEntries)
+    return;
+
+  // at most half full
+  int logSize = 1;
+  while ((double) (1ull << logSize) < 2 * numEntries)
+    logSize++;
+  decodeTableShift = 64 - logSize;
+
+  DecodeEntry empty = {0, -1, 0, 0};
+  decodeTable.assign((size_t) 1 << logSize, empty);
+
+  for (unsigned int id = 0; id < codes.size(); id++)
+    addDecodeEntries(codes[id], id, 0, 0);
+}
+
+void TagFamily::addDecodeEntries(unsigned long long code, int id, int firstBit, int hamming) {
+  // decode rotates the observed code rot times before comparing, so an
+  // observed code matching at rot is the variant rotated back 4-rot times
+  unsigned long long rCode = code;
+  addDecodeEntry(rCode, id, 0, hamming);
+  for (int rot = 3; rot > 0; rot--) {
+    rCode = rotate90(rCode, dimension);
+    addDecodeEntry(rCode, id, rot, hamming);
+  }
+
+  if (hamming == errorRecoveryBits)
+    return;
+  for (int b = firstBit; b < bits; b++)
+    addDecodeEntries(code ^ (1ull << b), id, b + 1, hamming + 1);
+}
+
+void TagFamily::addDecodeEntry(unsigned long long rCode, int id, int rotation, int hamming) {
+  const size_t mask = decodeTable.size() - 1;
+  for (size_t slot = decodeSlot(rCode);; slot = (slot + 1) & mask) {
+    DecodeEntry& e = decodeTable[slot];
+    if (e.id < 0) {
+      e.code = rCode;
+      e.id = id;
+      e.rotation = (unsigned char) rotation;
+      e.hammingDistance = (unsigned char) hamming;
+      return;
+    }
+    if (e.code == rCode) {
+      // keep what the exhaustive search would find: the closest code, then
+      // the lowest id, then the lowest rotation
+      if (hamming < e.hammingDistance ||
+          (hamming == e.hammingDistance && (id < e.id || (id == e.id && rotation < e.rotation)))) {
+        e.id = id;
+        e.rotation = (unsigned char) rotation;
+        e.hammingDistance = (unsigned char) hamming;
+      }
+      return;
+    }
+  }
 }
 
 unsigned long long TagFamily::rotate90(unsigned long long w, int d) {
@@ -81,6 +152,29 @@ int TagFamily::popCount(unsigned long long w) {
 }
 
 void TagFamily::decode(TagDetection& det, unsigned long long rCode) const {
+  if (!decodeTable.empty()) {
+    const size_t mask = decodeTable.size() - 1;
+    size_t slot = decodeSlot(rCode);
+    while (decodeTable[slot].id >= 0 && decodeTable[slot].code != rCode)
+      slot = (slot + 1) & mask;
+
+    const DecodeEntry& e = decodeTable[slot];
+    if (e.id >= 0) {
+      det.id = e.id;
+      det.hammingDistance = e.hammingDistance;
+      det.rotation = e.rotation;
+      det.code = codes[e.id];
+    } else {
+      det.id = -1;
+      det.hammingDistance = errorRecoveryBits + 1;
+      det.rotation = 0;
+      det.code = 0;
+    }
+    det.good = (det.hammingDistance <= errorRecoveryBits);
+    det.obsCode = rCode;
+    return;
+  }
+
   int  bestId = -1;
   int  bestHamming = INT_MAX;
   int  bestRotation = 0;
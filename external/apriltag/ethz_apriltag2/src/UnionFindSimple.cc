@@ -3,20 +3,6 @@
 
 namespace AprilTags {
 
-int UnionFindSimple::getRepresentative(int thisId) {
-  // terminal case: a node is its own parent
-  if (data[thisId].id == thisId)
-    return thisId;
-
-  // otherwise, recurse...
-  int root = getRepresentative(data[thisId].id);
-
-  // short circuit the path
-  data[thisId].id = root;
-
-  return root;
-}
-
 void UnionFindSimple::printDataVector() const {
   for (unsigned int i = 0; i < data.size(); i++)
     std::cout << "data[" << i << "]: " << " id:" << data[i].id << " size:" << data[i].size << std::endl;
@@ -13,13 +13,18 @@ namespace basalt {
 
         ~ApriltagDetector();
 
-        void detectTags(basalt::ManagedImage<uint16_t>& img_raw,
+        // img_raw may be a sub-image (pitch larger than its width), corners are reported relative to its origin
+        void detectTags(const basalt::Image<uint16_t>& img_raw,
                         Eigen::aligned_vector<Eigen::Vector2d>& corners,
                         std::vector<int>& ids, std::vector<double>& radii,
                         Eigen::aligned_vector<Eigen::Vector2d>& corners_rejected,
                         std::vector<int>& ids_rejected,
                         std::vector<double>& radii_rejected);
 
+        // Quads are searched for at 1/factor resolution, tags are still decoded and refined at full resolution
+        void setQuadDecimate(int factor);
+        int getQuadDecimate() const;
+
     private:
         ApriltagDetectorData* data;
         int _startId;
@@ -5,6 +5,9 @@
 
 #include <apriltags/Tag36h11.h>
 #include <apriltags/Tag16h5.h>
+
+#include <map>
+#include <stdexcept>
 namespace basalt {
 
     struct ApriltagDetectorData {
@@ -51,8 +54,16 @@ namespace basalt {
 
     ApriltagDetector::~ApriltagDetector() { delete data; }
 
+    void ApriltagDetector::setQuadDecimate(int factor) {
+        if (factor < 1)
+            throw std::invalid_argument("quad decimation factor must be at least 1");
+        data->_tagDetector->quadDecimate = factor;
+    }
+
+    int ApriltagDetector::getQuadDecimate() const { return data->_tagDetector->quadDecimate; }
+
     void ApriltagDetector::detectTags(
-            basalt::ManagedImage<uint16_t>& img_raw,
+            const basalt::Image<uint16_t>& img_raw,
             Eigen::aligned_vector<Eigen::Vector2d>& corners, std::vector<int>& ids,
             std::vector<double>& radii,
             Eigen::aligned_vector<Eigen::Vector2d>& corners_rejected,
@@ -64,18 +75,23 @@ namespace basalt {
         ids_rejected.clear();
         radii_rejected.clear();
 
-        cv::Mat image(img_raw.h, img_raw.w, CV_8U);
+        // Reused across calls, like the scratch buffers of the tag detector
+        static thread_local cv::Mat image;
+        image.create(img_raw.h, img_raw.w, CV_8U);
 
-        uint8_t* dst = image.ptr();
-        const uint16_t* src = img_raw.ptr;
+        for (size_t y = 0; y < img_raw.h; y++) {
+            uint8_t* dst = image.ptr<uint8_t>(y);
+            const uint16_t* src = reinterpret_cast<const uint16_t*>(
+                    reinterpret_cast<const uint8_t*>(img_raw.ptr) + y * img_raw.pitch);
 
-        for (size_t i = 0; i < img_raw.size(); i++) {
-            dst[i] = (src[i] >> 8);
+            for (size_t x = 0; x < img_raw.w; x++) {
+                dst[x] = (src[x] >> 8);
+            }
         }
 
         // detect the tags
-        std::vector<AprilTags::TagDetection> detections =
-                data->_tagDetector->extractTags(image, _startId);
+        static thread_local std::vector<AprilTags::TagDetection> detections;
+        data->_tagDetector->extractTags(image, detections, _startId);
 
         /* handle the case in which a tag is identified but not all tag
    * corners are in the image (all data bits in image but border
@@ -167,36 +183,43 @@ namespace basalt {
         ///    y     | TAG 0 |  | TAG 1 |
         ///   ^      0-------1  4-------5
         ///   |-->x
-        cv::Mat tagCorners(4 * detections.size(), 2, CV_32F);
+        std::vector<cv::Point2f> tagCornersRaw(4 * detections.size());
 
         for (unsigned i = 0; i < detections.size(); i++) {
             for (unsigned j = 0; j < 4; j++) {
-                tagCorners.at<float>(4 * i + j, 0) = detections[i].p[j].first;
-                tagCorners.at<float>(4 * i + j, 1) = detections[i].p[j].second;
+                tagCornersRaw[4 * i + j] = cv::Point2f(detections[i].p[j].first, detections[i].p[j].second);
             }
         }
 
-        // store a copy of the corner list before subpix refinement
-        cv::Mat tagCornersRaw = tagCorners.clone();
+        std::vector<cv::Point2f> tagCorners = tagCornersRaw;
 
         // optional subpixel refinement on all tag corners (four corners each tag)
         if (data->doSubpixRefinement) {
-            for (size_t i = 0; i < detections.size(); i++) {
-                cv::Mat currentCorners(4, 2, CV_32F);
-                for (unsigned j = 0; j < 4; j++) {
-                    currentCorners.at<float>(j, 0) = tagCorners.at<float>(4 * i + j, 0);
-                    currentCorners.at<float>(j, 1) = tagCorners.at<float>(4 * i + j, 1);
+            // cornerSubPix refines every corner on its own, so all tags sharing a search window size are refined in
+            // a single call. Tags of a board are about the same size in the image, there are only a few buckets.
+            std::map<int, std::vector<unsigned>> buckets;
+            for (unsigned i = 0; i < detections.size(); i++) {
+                buckets[static_cast<int>(std::ceil(radiiRaw[i] + 1.0))].push_back(i);
+            }
+
+            std::vector<cv::Point2f> bucketCorners;
+            for (const auto& bucket : buckets) {
+                const int radius = bucket.first;
+
+                bucketCorners.clear();
+                for (unsigned i : bucket.second) {
+                    bucketCorners.insert(bucketCorners.end(), tagCorners.begin() + 4 * i,
+                                         tagCorners.begin() + 4 * i + 4);
                 }
 
-                const int radius = static_cast<int>(std::ceil(radiiRaw[i] + 1.0));
                 cv::cornerSubPix(
-                        image, currentCorners, cv::Size(radius, radius), cv::Size(-1, -1),
+                        image, bucketCorners, cv::Size(radius, radius), cv::Size(-1, -1),
                         cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER,
                                          100, 0.01));
 
-                for (unsigned j = 0; j < 4; j++) {
-                    tagCorners.at<float>(4 * i + j, 0) = currentCorners.at<float>(j, 0);
-                    tagCorners.at<float>(4 * i + j, 1) = currentCorners.at<float>(j, 1);
+                for (size_t k = 0; k < bucket.second.size(); k++) {
+                    std::copy(bucketCorners.begin() + 4 * k, bucketCorners.begin() + 4 * k + 4,
+                              tagCorners.begin() + 4 * bucket.second[k]);
                 }
             }
         }
@@ -230,12 +253,12 @@ namespace basalt {
                 int pointId = (tagId << 2) + j;
 
                 // refined corners
-                double corner_x = tagCorners.row(4 * i + j).at<float>(0);
-                double corner_y = tagCorners.row(4 * i + j).at<float>(1);
+                double corner_x = tagCorners[4 * i + j].x;
+                double corner_y = tagCorners[4 * i + j].y;
 
                 // raw corners
-                double cornerRaw_x = tagCornersRaw.row(4 * i + j).at<float>(0);
-                double cornerRaw_y = tagCornersRaw.row(4 * i + j).at<float>(1);
+                double cornerRaw_x = tagCornersRaw[4 * i + j].x;
+                double cornerRaw_y = tagCornersRaw[4 * i + j].y;
 
                 // only add point if the displacement in the subpixel refinement is below
                 // a given threshold
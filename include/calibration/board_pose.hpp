@@ -0,0 +1,52 @@
+#pragma once
+
+#include "calibration/calibration_data.hpp"
+#include "calibration/corner_table.hpp"
+#include <basalt/calibration/calibration.hpp>
+#include <basalt/utils/sophus_utils.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace basalt {
+    struct BoardPoseParams {
+        // Corners that reproject farther from their detection are outliers [px]
+        double inlier_threshold = 2.0;
+
+        // RANSAC stops early once a sample of inliers only has been drawn with this probability
+        int max_iterations = 200;
+        double confidence = 0.999;
+
+        // Poses supported by fewer inliers are rejected
+        size_t min_inliers = 8;
+
+        // Gauss-Newton iterations on the reprojection error of the inliers
+        int refine_iterations = 10;
+    };
+
+    /*
+     * Pose of a planar target (z = 0) in a camera with known intrinsics, from the detected corners of one image.
+     * board_corners are the corner positions of the target indexed by corner id, see aprilgrid_corners.
+     *
+     * Hypotheses are homographies of four corners between the target plane and the unprojected corners, scored by the
+     * number of corners they reproject within inlier_threshold. The best one is refit to all of its inliers and
+     * refined on their reprojection error. Samples are drawn from seed, so that the result does not depend on which
+     * thread runs it.
+     *
+     * Fills pose with T_a_c, the number of inliers and the projections of all board_corners (NaN for those behind the
+     * camera). Returns false if no pose has min_inliers inliers.
+     * */
+    bool estimate_board_pose(const GenericCamera<double> &cam,
+                             const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                             const CompactCornerData &corners, const BoardPoseParams &params, uint64_t seed,
+                             CalibInitPoseData &pose);
+
+    /*
+     * Replaces init_poses with the board pose of every image in corners, estimated with the intrinsics of calib, in
+     * parallel over (frame, camera). Images without a pose get no entry. Returns the number of poses, throws
+     * std::invalid_argument if the corners are of more cameras than calib has.
+     * */
+    size_t compute_init_poses(const CalibCornerTable &corners, const Calibration<double> &calib,
+                              const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                              const BoardPoseParams &params, CalibInitPoseMap &init_poses);
+}// namespace basalt
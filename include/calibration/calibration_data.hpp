@@ -18,6 +18,7 @@ namespace basalt {
         //! during sub-pix refinement; Search region is
         size_t seq;// no need to set in constructor, tbb loop does it
         //! slightly larger.
+        bool prefiltered = false;//!< frame was rejected by the board-presence pre-filter, no detection was run
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
         CalibCornerData() = default;
 
@@ -47,17 +48,44 @@ namespace basalt {
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     };
 
-    using CalibCornerMap = tbb::concurrent_unordered_map<TimeCamId, CalibCornerData,
-            std::hash<TimeCamId>>;
-
     using CalibInitPoseMap =
             tbb::concurrent_unordered_map<TimeCamId, CalibInitPoseData,
                     std::hash<TimeCamId>>;
 
+    // Loads a camera model in the format of the files in priors/, throws std::runtime_error if it can not be read
+    Calibration<double> load_calibration(const std::string &path);
+
+    /*
+     * Corner positions of a target, indexed by the corner ids the detectors report: 4 * tag id + corner for AprilGrids
+     * and row * cols + col for checkerboards (cols x rows inner corners, squares of square_size [m]).
+     *
+     * The board frame follows the AprilGrid convention of Kalibr: the origin is the bottom left corner of tag 0 (the
+     * first inner corner of a checkerboard), x points right, y up and z out of the printed side, so z is 0.
+     * */
+    Eigen::aligned_vector<Eigen::Vector3d> aprilgrid_corners(const AprilGrid &grid);
+    Eigen::aligned_vector<Eigen::Vector3d> checkerboard_corners(int cols, int rows, double square_size);
+
+    /*
+     * Base class of the detector backends. A backend detects one kind of target and reports its corners with ids that
+     * are unique on the board. Backends are created through the DetectorRegistry (see detector_registry.hpp).
+     * */
     class CalibParams {
     public:
+        // What a backend supports beyond process, see capabilities()
+        enum Capability : uint32_t {
+            CAP_ROI = 1u << 0,// process_roi only searches the roi, otherwise it searches the full image
+            CAP_THREAD_SAFE = 1u << 1,// process may be called from several threads at once
+            CAP_BATCH = 1u << 2,// process_batch is faster than calling process for every image
+            CAP_PARTIAL_BOARD = 1u << 3,// detects boards that are only partially visible
+        };
+
         virtual ~CalibParams() = default;
 
+        // Bitwise or of Capability flags
+        virtual uint32_t capabilities() const { return 0; }
+
+        inline bool has_capability(Capability cap) const { return (this->capabilities() & cap) != 0; }
+
         /*
          * process method will be called in the detectCorners loop for each ManagedImage.
          * AprilGrid detection right now takes in a Managed image, but preferably we can make the tag detector take in
@@ -66,16 +94,70 @@ namespace basalt {
          * image to the find_corners function.
          * */
         virtual void
-        process(basalt::ManagedImage<uint16_t> &img_raw, CalibCornerData &ccd_good, CalibCornerData &ccd_bad) = 0;
+        process(basalt::ManagedImage<uint16_t> &img_raw, CalibCornerData &ccd_good, CalibCornerData &ccd_bad) {
+            this->process_roi(img_raw, cv::Rect(), ccd_good, ccd_bad);
+        }
+
+        /*
+         * Same as process, but only searches for the board inside roi. Corners are still reported in full image
+         * coordinates. An empty roi searches the full image.
+         * */
+        virtual void
+        process_roi(basalt::ManagedImage<uint16_t> &img_raw, const cv::Rect &roi, CalibCornerData &ccd_good,
+                    CalibCornerData &ccd_bad) = 0;
+
+        /*
+         * Detects the board in every image of imgs, typically the images of all cameras at one timestamp. good and bad
+         * are resized to the number of images, the entries of null images are left empty. The default calls process
+         * for every image, backends that can share work between images override it and report CAP_BATCH.
+         * */
+        virtual void process_batch(const std::vector<basalt::ManagedImage<uint16_t>::Ptr> &imgs,
+                                   std::vector<CalibCornerData> &good, std::vector<CalibCornerData> &bad);
+
+        /*
+         * Search region for the next frame of the same camera, given the corners found in this frame. The bounding box
+         * of the corners is padded on every side by roi_padding_ratio of its size (at least roi_min_padding pixels),
+         * to allow for board motion between frames.
+         * */
+        cv::Rect tracking_roi(const CalibCornerData &ccd, const cv::Size &img_size) const;
+
+        // When enabled, detectCorners seeds each frame's search with the tracking_roi of the previous frame
+        inline void set_roi_tracking(bool enable) { this->roi_tracking = enable; }
+        inline bool get_roi_tracking() const { return this->roi_tracking; }
+
+        /*
+         * Cheap check (well below a millisecond) whether the frame can contain a board at all, used to skip the
+         * detector on empty frames. Looks at the intensity range and the amount of strong edges of a subsampled
+         * image, so it may accept frames without a board but should never reject one with a detectable board.
+         * */
+        bool board_likely(const basalt::ManagedImage<uint16_t> &img_raw) const;
+
+        // When enabled, detectCorners skips frames that fail board_likely and marks them as prefiltered
+        inline void set_prefilter(bool enable) { this->prefilter = enable; }
+        inline bool get_prefilter() const { return this->prefilter; }
 
-        std::string getTargetType() {
-            assert(targetType.empty());
+        std::string getTargetType() const {
+            assert(!targetType.empty());
 
             return targetType;
         }
 
+        /*
+         * The target type and the board geometry the corner ids refer to, corners cached for one key are not used for
+         * another. Backends of a target with parameters beyond its type override it.
+         * */
+        virtual std::string getTargetKey() const { return this->getTargetType(); }
+
     protected:
         std::string targetType;
+
+        bool roi_tracking = false;
+        double roi_padding_ratio = 0.15;
+        int roi_min_padding = 24;
+
+        bool prefilter = false;
+        double prefilter_min_contrast = 0.1;// 5th to 95th intensity percentile, relative to the full range
+        double prefilter_min_edge_fraction = 0.005;// of subsampled pixels
     };
 
     class AprilGridParams : public CalibParams {
@@ -91,8 +173,29 @@ namespace basalt {
 
         std::shared_ptr<AprilGrid> getParams() { return april_grid; }
 
+        // Type, tag rows and columns, tag size and spacing, family and first id
+        std::string getTargetKey() const override;
+
+        uint32_t capabilities() const override { return CAP_ROI | CAP_THREAD_SAFE | CAP_PARTIAL_BOARD; }
+
         void
-        process(basalt::ManagedImage<uint16_t> &img_raw, CalibCornerData &ccd_good, CalibCornerData &ccd_bad) override;
+        process_roi(basalt::ManagedImage<uint16_t> &img_raw, const cv::Rect &roi, CalibCornerData &ccd_good,
+                    CalibCornerData &ccd_bad) override;
+
+        // Quads are searched for at 1/factor resolution, see ApriltagDetector::setQuadDecimate
+        inline void set_quad_decimate(int factor) { this->ad.setQuadDecimate(factor); }
+        inline int get_quad_decimate() const { return this->ad.getQuadDecimate(); }
+
+        /*
+         * Largest quad decimation factor at which the tags of grid are still found in every camera of calib, with the
+         * board up to max_distance [m] away. The tag size in pixels is that of a tag facing the camera on its optical
+         * axis. Tags are found from about 13 pixels per side after decimation, MIN_DECIMATED_TAG_PX leaves room for
+         * oblique views and the shrinking towards the edges of wide angle lenses.
+         * */
+        static int auto_quad_decimate(const AprilGrid &grid, const Calibration<double> &calib, double max_distance);
+
+        static constexpr double MIN_DECIMATED_TAG_PX = 20.0;
+        static constexpr int MAX_QUAD_DECIMATE = 4;
 
     private:
         std::shared_ptr<AprilGrid> april_grid;
@@ -102,11 +205,13 @@ namespace basalt {
     class OpenCVCheckerboardParams : public CalibParams {
     public:
         OpenCVCheckerboardParams(int width, int height, bool adaptive_thresh, bool normalize_image,
-                                 bool filter_quads, bool fast_check, bool enable_subpix_refine)
+                                 bool filter_quads, bool fast_check, bool enable_subpix_refine,
+                                 int pyramid_level = 0)
                                  : width(width),
                                  height(height),
                                  flags(0),
-                                 enable_subpix_refine(enable_subpix_refine) {
+                                 enable_subpix_refine(enable_subpix_refine),
+                                 pyramid_level(std::max(0, pyramid_level)) {
             // Access prams to get flags
             this->flags += adaptive_thresh ? cv::CALIB_CB_ADAPTIVE_THRESH : 0;
             this->flags += filter_quads ? cv::CALIB_CB_FILTER_QUADS : 0;
@@ -114,25 +219,47 @@ namespace basalt {
             this->flags += fast_check ? cv::CALIB_CB_FAST_CHECK : 0;
             this->enable_subpix_refine = enable_subpix_refine;
 
-            targetType = "checkerboard_opencv";
+            // Corners are the inner corners of the board, the search region also needs the outer ring of squares
+            this->roi_padding_ratio += 1.25 / std::max(1, std::min(width, height) - 1);
+
+            targetType = "checkerboard";
         }
 
         OpenCVCheckerboardParams() = delete;
 
+        // Type and number of inner corners
+        std::string getTargetKey() const override;
+
+        uint32_t capabilities() const override { return CAP_ROI | CAP_THREAD_SAFE; }
+
         void
-        process(basalt::ManagedImage<uint16_t> &img_raw, CalibCornerData &ccd_good, CalibCornerData &ccd_bad) override;
+        process_roi(basalt::ManagedImage<uint16_t> &img_raw, const cv::Rect &roi, CalibCornerData &ccd_good,
+                    CalibCornerData &ccd_bad) override;
 
     protected:
         int width;
         int height;
         int flags;
         bool enable_subpix_refine;
+        /*
+         * 0 searches the full resolution image with findChessboardCornersSB. Otherwise the board is searched on a
+         * 1/2^pyramid_level downsampled image and the corners are refined at full resolution.
+         * */
+        int pyramid_level;
+
+    private:
+        bool find_corners_coarse(const cv::Mat &gray8, std::vector<cv::Point2f> &corners) const;
     };
 }// namespace basalt
 
 namespace cereal {
     template<class Archive>
-    void serialize(Archive &ar, basalt::CalibCornerData &c) {
+    void serialize(Archive &ar, basalt::CalibCornerData &c, const std::uint32_t version) {
         ar(c.corners, c.corner_ids, c.radii, c.seq);
+        if (version >= 1) {
+            ar(c.prefiltered);
+        }
     }
-}// namespace cereal
\ No newline at end of file
+}// namespace cereal
+
+CEREAL_CLASS_VERSION(basalt::CalibCornerData, 1);
\ No newline at end of file
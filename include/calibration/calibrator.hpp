@@ -158,10 +158,14 @@
 
 #pragma once
 
+#include "calibration/board_pose.hpp"
+#include "calibration/corner_cache.hpp"
+#include "calibration/corner_export.hpp"
 #include "io/dataset_io.h"
 
 #include <spdlog/spdlog.h>
 #include <tbb/concurrent_unordered_map.h>
+#include <tbb/blocked_range2d.h>
 #include <tbb/parallel_for.h>
 
 namespace fs = std::filesystem;
@@ -173,39 +177,120 @@ namespace basalt {
 
         ~Calibrator() = default;
 
-        inline bool loadCache() {
-            std::ifstream is(this->cache_path, std::ios::binary);
+        // Loads the cached corners if they were detected on this dataset, for the target of params
+        inline bool loadCache(const CalibParams &params) {
+            if (!this->use_cache) {
+                return false;
+            }
+
+            if (!fs::exists(this->cache_path)) {
+                return false;
+            }
 
-            if (is.good()) {
-                cereal::BinaryInputArchive archive(is);
+            // The corners stay in the mapped file, loading only reads the frame tables
+            try {
+                const CornerCacheFile cache = CornerCacheFile::open(this->cache_path);
+                if (cache.fingerprint() != this->cacheFingerprint(params)) {
+                    spdlog::warn("Ignoring corner cache {}, it belongs to a different dataset or target",
+                                 this->cache_path.string());
+                    return false;
+                }
+                cache.load(CornerCacheFile::CORNERS, this->dataset->calib_corners);
+                cache.load(CornerCacheFile::REJECTED, this->dataset->calib_corners_rejected);
+            } catch (const std::runtime_error &e) {
+                // Cache written by an older version, detect again
+                spdlog::warn("Ignoring unreadable corner cache {}: {}", this->cache_path.string(), e.what());
+                return false;
+            }
 
-                this->dataset->calib_corners.clear();
-                this->dataset->calib_corners_rejected.clear();
-                archive(this->dataset->calib_corners);
-                archive(this->dataset->calib_corners_rejected);
+            spdlog::info("Loaded cached corners into memory, from: {}", this->cache_path.string());
+            return true;
+        }
 
-                spdlog::info("Loaded cached corners into memory, from: {}", this->cache_path.string());
-                return true;
+        inline void saveCache(const CalibParams &params) {
+            try {
+                save_corner_cache(this->cache_path, this->cacheFingerprint(params), this->dataset->calib_corners,
+                                  this->dataset->calib_corners_rejected);
+            } catch (const std::runtime_error &e) {
+                spdlog::error("Could not cache detected corners: {}", e.what());
+                return;
             }
-            return false;
+
+            spdlog::info("Cached detected corners here: {}", this->cache_path.string());
         }
 
-        inline void saveCache() {
-            std::ofstream os(this->cache_path, std::ios::binary);
-            cereal::BinaryOutputArchive archive(os);
+        // Human readable dump of the detected corners, next to the cache
+        inline void saveJson() {
+            export_corners_json(this->json_path, this->dataset->calib_corners, this->dataset->calib_corners_rejected);
 
-            archive(this->dataset->calib_corners);
-            archive(this->dataset->calib_corners_rejected);
+            spdlog::info("Wrote detected corners here: {}", this->json_path.string());
+        }
 
-            spdlog::info("Cached detected corners here: {}", this->cache_path.string());
+        // Corner observations as a Kalibr style CSV, next to the JSON dump
+        inline void saveCsv() {
+            const fs::path csv_path = fs::path(this->json_path).replace_extension(".csv");
+            export_corners_kalibr_csv(csv_path, this->dataset->calib_corners);
+
+            spdlog::info("Wrote detected corners here: {}", csv_path.string());
+        }
+
+        // When disabled, detectCorners always runs detection and overwrites an existing cache
+        inline void set_use_cache(bool enable) { this->use_cache = enable; }
+
+        // When disabled, detectCorners leaves the cache file alone, e.g. when comparing detectors
+        inline void set_save_cache(bool enable) { this->save_cache = enable; }
+
+        // Defaults to calib-cam_detected_corners.{corners,json} in the directory of the bag
+        inline void set_output_paths(const fs::path &cache, const fs::path &json) {
+            this->cache_path = cache;
+            this->json_path = json;
         }
 
+        inline const fs::path &get_cache_path() const { return this->cache_path; }
+
+        inline const fs::path &get_json_path() const { return this->json_path; }
+
+        /*
+         * When enabled, detectCorners also fills dataset->frame_quality. Off by default: on a cache hit every image of
+         * the bag is decoded again just for the scores.
+         * */
+        inline void set_frame_quality(bool enable) { this->frame_quality = enable; }
+
         void detectCorners(const std::shared_ptr<CalibParams> &params);
 
+        // Fills dataset->frame_quality for every frame, without running detection
+        void computeFrameQuality();
+
+        /*
+         * Fills dataset->calib_init_poses with the target pose of every image with detected corners, estimated with
+         * the intrinsics of calib, see compute_init_poses. detectCorners clears them.
+         * */
+        void computeInitPoses(const Calibration<double> &calib,
+                              const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                              const BoardPoseParams &params = BoardPoseParams());
+
 
     protected:
+        // Identifies the dataset and the target in the corner cache
+        inline uint64_t cacheFingerprint(const CalibParams &params) const {
+            return dataset_fingerprint(this->dataset->get_image_timestamps(), this->dataset->get_num_cams(),
+                                       params.getTargetKey());
+        }
+
         std::shared_ptr<RosbagDataset> dataset;
         std::shared_ptr<CalibParams> params;
         fs::path cache_path;
+        fs::path json_path;
+        bool use_cache = true;
+        bool save_cache = true;
+
+        bool frame_quality = false;
+        FrameQualityEstimator quality_estimator;
+
+    private:
+        // Downsampled images of frame j - 1, the motion reference for frame j, of cameras [cam_begin, cam_end)
+        std::vector<cv::Mat> motionReference(size_t j, size_t cam_begin, size_t cam_end);
+
+        void updateFrameQuality(const TimeCamId &tcid, const ManagedImage<uint16_t>::Ptr &img, cv::Mat &prev_small);
     };
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "calibration/calibration_data.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace basalt {
+    /*
+     * Corners of one image in a compact structure of arrays: float32 positions, uint16 ids and radii quantized to
+     * RADIUS_STEP, all in a single allocation. That is 11 bytes per corner instead of the 28 of CalibCornerData,
+     * which spreads them over three vectors.
+     *
+     * This is how detection results are stored (see CalibCornerTable). Detectors still produce CalibCornerData, code
+     * that needs that layout converts with to_calib_corner_data() at its boundary and everything else reads through
+     * the accessors.
+     *
+     * The arrays are immutable and shared between copies. They live on the heap or in a memory mapped corner cache
+     * file (see CornerCacheFile), which stays mapped while corners refer to it.
+     * */
+    class CompactCornerData {
+    public:
+        static constexpr double RADIUS_STEP = 0.25;// [px]
+        static constexpr double MAX_RADIUS = 255 * RADIUS_STEP;
+
+        CompactCornerData() = default;
+
+        // Radii are rounded to RADIUS_STEP and clamped to MAX_RADIUS. Throws std::out_of_range for ids above 65535.
+        explicit CompactCornerData(const CalibCornerData &ccd);
+
+        /*
+         * Corners in arrays owned by someone else, e.g. a mapped file. arrays holds BYTES_PER_CORNER * num_corners
+         * bytes in the layout of xs(), ys(), ids() and quantized_radii(), aligned for float.
+         * */
+        static CompactCornerData view(std::shared_ptr<const uint8_t> arrays, uint32_t num_corners, size_t seq,
+                                      bool prefiltered);
+
+        CalibCornerData to_calib_corner_data() const;
+
+        inline size_t size() const { return this->num_corners; }
+
+        inline bool empty() const { return this->num_corners == 0; }
+
+        inline Eigen::Vector2d corner(size_t i) const { return Eigen::Vector2d(this->xs()[i], this->ys()[i]); }
+
+        inline int id(size_t i) const { return this->ids()[i]; }
+
+        inline double radius(size_t i) const { return this->quantized_radii()[i] * RADIUS_STEP; }
+
+        // The arrays, num_corners entries each
+        inline const float *xs() const { return reinterpret_cast<const float *>(this->arrays.get()); }
+        inline const float *ys() const { return this->xs() + this->num_corners; }
+        inline const uint16_t *ids() const {
+            return reinterpret_cast<const uint16_t *>(this->arrays.get() + 2 * sizeof(float) * this->num_corners);
+        }
+        inline const uint8_t *quantized_radii() const {
+            return this->arrays.get() + (2 * sizeof(float) + sizeof(uint16_t)) * this->num_corners;
+        }
+
+        // All arrays, back to back, memory_bytes() long
+        inline const uint8_t *data() const { return this->arrays.get(); }
+
+        inline size_t memory_bytes() const { return BYTES_PER_CORNER * this->num_corners; }
+
+        size_t seq = 0;// index of the image timestamp, see CalibCornerData
+        bool prefiltered = false;
+
+        static constexpr size_t BYTES_PER_CORNER = 2 * sizeof(float) + sizeof(uint16_t) + sizeof(uint8_t);
+
+    private:
+        // xs, then ys, ids and quantized radii
+        std::shared_ptr<const uint8_t> arrays;
+        uint32_t num_corners = 0;
+    };
+}// namespace basalt
+
+namespace cereal {
+    /*
+     * Binary archives hold the arrays as they are, text archives (the JSON dump) the corners in the layout of
+     * CalibCornerData, so the dump reads the same as before.
+     * */
+    template<class Archive>
+    void save(Archive &ar, const basalt::CompactCornerData &c) {
+        if constexpr (traits::is_text_archive<Archive>::value) {
+            ar(c.to_calib_corner_data());
+        } else {
+            ar(static_cast<uint32_t>(c.size()), c.seq, c.prefiltered);
+            ar(binary_data(c.data(), c.memory_bytes()));
+        }
+    }
+
+    template<class Archive>
+    void load(Archive &ar, basalt::CompactCornerData &c) {
+        if constexpr (traits::is_text_archive<Archive>::value) {
+            basalt::CalibCornerData ccd;
+            ar(ccd);
+            c = basalt::CompactCornerData(ccd);
+        } else {
+            uint32_t num_corners = 0;
+            size_t seq = 0;
+            bool prefiltered = false;
+            ar(num_corners, seq, prefiltered);
+
+            std::shared_ptr<uint8_t> arrays(new uint8_t[basalt::CompactCornerData::BYTES_PER_CORNER * num_corners],
+                                            std::default_delete<uint8_t[]>());
+            ar(binary_data(arrays.get(), basalt::CompactCornerData::BYTES_PER_CORNER * num_corners));
+            c = basalt::CompactCornerData::view(std::move(arrays), num_corners, seq, prefiltered);
+        }
+    }
+}// namespace cereal
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "calibration/corner_table.hpp"
+#include "utils/filesystem.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace basalt {
+    /*
+     * Flat file of detected corners, laid out so that it can be memory mapped and read in place. All integers are
+     * little endian, all offsets count bytes from the start of the file and are 8 byte aligned:
+     *
+     *   CornerCacheHeader
+     *   per table: num_frames int64 timestamps, then num_frames * num_cams CornerCacheSlot, frame major
+     *   arena: the arrays of CompactCornerData, one block per filled slot
+     *
+     * The file holds two tables, the accepted and the rejected corners of the dataset. The fingerprint identifies the
+     * dataset and the target the corners belong to, see dataset_fingerprint().
+     * */
+    struct CornerCacheTableHeader {
+        uint64_t num_frames;
+        uint64_t num_cams;
+        uint64_t timestamps_offset;
+        uint64_t slots_offset;
+    };
+
+    struct CornerCacheSlot {
+        static constexpr uint32_t FILLED = 1;
+        static constexpr uint32_t PREFILTERED = 2;
+
+        uint64_t offset;// of the corner arrays, relative to the arena
+        uint64_t seq;
+        uint32_t num_corners;
+        uint32_t flags;
+    };
+
+    struct CornerCacheHeader {
+        static constexpr char MAGIC[8] = {'C', 'O', 'R', 'N', 'C', 'A', 'C', 'H'};
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t NUM_TABLES = 2;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t num_tables;
+        uint64_t fingerprint;
+        uint64_t file_size;
+        uint64_t arena_offset;
+        uint64_t arena_size;
+        CornerCacheTableHeader tables[NUM_TABLES];
+    };
+
+    static_assert(sizeof(CornerCacheTableHeader) == 32);
+    static_assert(sizeof(CornerCacheSlot) == 24);
+    static_assert(sizeof(CornerCacheHeader) == 48 + 2 * sizeof(CornerCacheTableHeader));
+
+    /*
+     * FNV-1a hash of the image timestamps, the number of cameras and the target key of the detector (see
+     * CalibParams::getTargetKey), which a cache has to match to be used
+     * */
+    uint64_t dataset_fingerprint(const std::vector<int64_t> &timestamps, size_t num_cams,
+                                 const std::string &target_key);
+
+    /*
+     * Writes corners and rejected into a corner cache at path. The file is written next to path and renamed over it,
+     * so mappings of a previous version stay valid. Throws std::runtime_error if writing fails.
+     * */
+    void save_corner_cache(const fs::path &path, uint64_t fingerprint, const CalibCornerTable &corners,
+                           const CalibCornerTable &rejected);
+
+    /*
+     * Read only mapping of a corner cache. Opening checks the header and the frame tables, corners are not touched
+     * until they are asked for and then returned as views into the mapping. The mapping lives as long as the file
+     * object or any corners taken from it.
+     * */
+    class CornerCacheFile {
+    public:
+        // Tables of the file
+        static constexpr size_t CORNERS = 0;
+        static constexpr size_t REJECTED = 1;
+
+        // Throws std::runtime_error if the file cannot be mapped or is not a valid corner cache
+        static CornerCacheFile open(const fs::path &path);
+
+        inline uint64_t fingerprint() const { return this->header->fingerprint; }
+
+        inline size_t file_size() const { return this->header->file_size; }
+
+        inline size_t num_frames(size_t table) const { return this->header->tables[table].num_frames; }
+
+        inline size_t num_cams(size_t table) const { return this->header->tables[table].num_cams; }
+
+        // num_frames(table) ascending timestamps, in the mapping
+        const int64_t *timestamps(size_t table) const;
+
+        // Index of timestamp in table, CalibCornerTable::npos if it has none
+        size_t frame_index(size_t table, int64_t timestamp) const;
+
+        // Corners of (frame, cam) in table, nothing if the slot is empty
+        std::optional<CompactCornerData> get(size_t table, size_t frame, size_t cam) const;
+
+        // Replaces the contents of out with table, as views into the mapping
+        void load(size_t table, CalibCornerTable &out) const;
+
+    private:
+        CornerCacheFile(std::shared_ptr<const uint8_t> mapping);
+
+        const CornerCacheSlot *slots(size_t table) const;
+
+        std::shared_ptr<const uint8_t> mapping;
+        const CornerCacheHeader *header = nullptr;
+    };
+}// namespace basalt
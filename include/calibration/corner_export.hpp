@@ -0,0 +1,25 @@
+#pragma once
+
+#include "calibration/corner_table.hpp"
+#include "utils/filesystem.h"
+
+namespace basalt {
+    /*
+     * Text exports of detected corners for other tools. Both stream the table to the file: frames are formatted in
+     * chunks on all threads and written in timestamp order, without building the document in memory. Throw
+     * std::runtime_error if the file cannot be written.
+     * */
+
+    /*
+     * JSON object with the arrays "corners" and "corners_rejected", one object per image on its own line:
+     *   {"timestamp_ns":..,"cam_id":..,"seq":..,"prefiltered":..,"corner_ids":[..],"corners":[[x,y],..],"radii":[..]}
+     * */
+    void export_corners_json(const fs::path &path, const CalibCornerTable &corners,
+                             const CalibCornerTable &rejected);
+
+    /*
+     * CSV with one row per corner observation, in the conventions of Kalibr and EuRoC datasets: timestamps in
+     * nanoseconds and a commented header line, "#timestamp [ns],cam_id,corner_id,x [px],y [px],radius [px]".
+     * */
+    void export_corners_kalibr_csv(const fs::path &path, const CalibCornerTable &corners);
+}// namespace basalt
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "calibration/compact_corners.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace basalt {
+    /*
+     * Corner detection results of a dataset, one slot per (frame, camera). The grid of image timestamps and cameras is
+     * known before detection starts, so reset() allocates all slots upfront and the parallel detection loop writes its
+     * results with set(), without locks or allocations in the table. Entries are kept ordered by timestamp and camera,
+     * iterating, serializing or looking up the corners of a frame walks memory sequentially.
+     *
+     * Corners are held as CompactCornerData. Besides that it behaves like a map of TimeCamId to corners: emplace, find,
+     * at, count and iteration over the filled slots as (TimeCamId, CompactCornerData) pairs. Emplacing a timestamp or
+     * camera outside of the grid grows it, which is not thread safe.
+     * */
+    class CalibCornerTable {
+    public:
+        using value_type = std::pair<TimeCamId, CompactCornerData>;
+
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        // Forward iterator over the filled slots
+        class const_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = CalibCornerTable::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type *;
+            using reference = const value_type &;
+
+            const_iterator() = default;
+
+            inline reference operator*() const { return this->table->slots[this->idx]; }
+            inline pointer operator->() const { return &this->table->slots[this->idx]; }
+
+            inline const_iterator &operator++() {
+                this->idx = this->table->next_filled(this->idx + 1);
+                return *this;
+            }
+
+            inline const_iterator operator++(int) {
+                const_iterator res = *this;
+                ++(*this);
+                return res;
+            }
+
+            inline bool operator==(const const_iterator &o) const { return this->idx == o.idx; }
+            inline bool operator!=(const const_iterator &o) const { return this->idx != o.idx; }
+
+        private:
+            friend class CalibCornerTable;
+
+            const_iterator(const CalibCornerTable *table, size_t idx) : table(table), idx(idx) {}
+
+            const CalibCornerTable *table = nullptr;
+            size_t idx = 0;
+        };
+
+        CalibCornerTable() = default;
+        CalibCornerTable(const CalibCornerTable &other);
+        CalibCornerTable(CalibCornerTable &&other) noexcept;
+        CalibCornerTable &operator=(const CalibCornerTable &other);
+        CalibCornerTable &operator=(CalibCornerTable &&other) noexcept;
+
+        // Empties the table and lays out a slot for every camera of every timestamp, timestamps must be ascending
+        void reset(const std::vector<int64_t> &timestamps, size_t num_cams);
+
+        // Empty table with the grid of other
+        inline void reset_like(const CalibCornerTable &other) { this->reset(other.timestamps, other.num_cams); }
+
+        /*
+         * Fills slot (frame, cam) of the grid. Lock free, threads may set different slots concurrently, but not
+         * concurrently with anything else on the table.
+         * */
+        void set(size_t frame, size_t cam, CompactCornerData data);
+
+        // Corners of slot (frame, cam), nullptr if it is not filled
+        inline const CompactCornerData *get(size_t frame, size_t cam) const {
+            const size_t idx = frame * this->num_cams + cam;
+            return this->filled[idx] ? &this->slots[idx].second : nullptr;
+        }
+
+        // Index of timestamp in the grid, npos if it has none
+        size_t frame_index(int64_t timestamp) const;
+
+        inline const std::vector<int64_t> &get_timestamps() const { return this->timestamps; }
+
+        inline size_t get_num_frames() const { return this->timestamps.size(); }
+
+        inline size_t get_num_cams() const { return this->num_cams; }
+
+        // Map interface
+        std::pair<const_iterator, bool> emplace(const TimeCamId &tcid, CompactCornerData data);
+
+        const_iterator find(const TimeCamId &tcid) const;
+
+        // Throws std::out_of_range if tcid is not filled
+        const CompactCornerData &at(const TimeCamId &tcid) const;
+
+        inline size_t count(const TimeCamId &tcid) const { return this->find(tcid) != this->end() ? 1 : 0; }
+
+        inline size_t size() const { return this->num_filled.load(std::memory_order_relaxed); }
+
+        inline bool empty() const { return this->size() == 0; }
+
+        // Removes all entries and the grid
+        void clear();
+
+        /*
+         * Replaces the contents with items, in any order. Builds the grid from the timestamps and cameras of the items
+         * in one go, unlike emplacing them one by one. Duplicates keep the last item.
+         * */
+        void assign(std::vector<value_type> &&items);
+
+        inline const_iterator begin() const { return const_iterator(this, this->next_filled(0)); }
+
+        inline const_iterator end() const { return const_iterator(this, this->slots.size()); }
+
+    private:
+        // Slot index of tcid, npos if it is outside of the grid
+        size_t slot_index(const TimeCamId &tcid) const;
+
+        size_t next_filled(size_t idx) const;
+
+        // Makes room for tcid in the grid, keeping the filled slots
+        void grow(const TimeCamId &tcid);
+
+        std::vector<int64_t> timestamps;
+        size_t num_cams = 0;
+
+        // Frame major, slot frame * num_cams + cam. Keys are set by reset, filled marks the slots holding corners.
+        std::vector<value_type> slots;
+        std::vector<uint8_t> filled;
+        std::atomic<size_t> num_filled{0};
+    };
+}// namespace basalt
+
+namespace cereal {
+    // Stored like a map of TimeCamId to corners, in timestamp and camera order
+    template<class Archive>
+    void save(Archive &ar, const basalt::CalibCornerTable &table) {
+        ar(make_size_tag(static_cast<size_type>(table.size())));
+        for (const auto &kv: table) {
+            ar(make_map_item(kv.first, kv.second));
+        }
+    }
+
+    template<class Archive>
+    void load(Archive &ar, basalt::CalibCornerTable &table) {
+        size_type size;
+        ar(make_size_tag(size));
+
+        std::vector<basalt::CalibCornerTable::value_type> items(static_cast<size_t>(size));
+        for (auto &item: items) {
+            ar(make_map_item(item.first, item.second));
+        }
+        table.assign(std::move(items));
+    }
+}// namespace cereal
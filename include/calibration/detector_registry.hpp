@@ -0,0 +1,78 @@
+#pragma once
+
+#include "calibration/calibration_data.hpp"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace basalt {
+    // Everything a backend may need to set itself up, backends ignore what does not apply to their target
+    struct DetectorConfig {
+        // AprilGrid targets
+        std::shared_ptr<AprilGrid> april_grid;
+
+        // Quad decimation factor of the tag detector, 0 selects it from camera_prior and max_target_distance
+        int quad_decimate = 1;
+        std::shared_ptr<Calibration<double>> camera_prior;
+        double max_target_distance = 2.0;// [m]
+
+        // Checkerboard targets, number of inner corners
+        int board_width = 0;
+        int board_height = 0;
+        bool adaptive_thresh = true;
+        bool normalize_image = true;
+        bool filter_quads = true;
+        bool fast_check = true;
+        bool enable_subpix_refine = true;
+        int pyramid_level = 0;
+    };
+
+    /*
+     * Named detector backends. Each backend detects one target type ("aprilgrid" or "checkerboard") and is created
+     * from a DetectorConfig, so a new detection engine only needs to register a factory to be usable by everything
+     * that goes through the registry, Calibrator only sees the CalibParams interface.
+     *
+     * The built-in backends are registered on first use:
+     *   aprilgrid            ETH AprilTag 2 detector
+     *   checkerboard_opencv  cv::findChessboardCornersSB at full resolution. With pyramid_level > 0,
+     *                        cv::findChessboardCorners on the downsampled image, refined by cv::cornerSubPix
+     * */
+    class DetectorRegistry {
+    public:
+        using Factory = std::function<std::shared_ptr<CalibParams>(const DetectorConfig &)>;
+
+        struct Backend {
+            std::string name;
+            std::string target;
+            std::string description;
+            Factory factory;
+        };
+
+        static DetectorRegistry &get_instance();
+
+        DetectorRegistry(const DetectorRegistry &) = delete;
+        DetectorRegistry &operator=(const DetectorRegistry &) = delete;
+
+        // Returns false if a backend of that name already exists
+        bool add(const Backend &backend);
+
+        /*
+         * Creates the backend called name. Throws std::invalid_argument for unknown names and for configs that lack
+         * what the backend's target needs.
+         * */
+        std::shared_ptr<CalibParams> create(const std::string &name, const DetectorConfig &config) const;
+
+        // All backends, or those detecting target, ordered by name
+        std::vector<Backend> list(const std::string &target = "") const;
+
+    private:
+        DetectorRegistry();
+
+        mutable std::mutex mutex;
+        std::map<std::string, Backend> backends;
+    };
+}// namespace basalt
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "calibration/calibration_data.hpp"
+#include "calibration/corner_table.hpp"
+#include "utils/common_types.h"
+#include <basalt/image/image.h>
+#include <tbb/concurrent_unordered_map.h>
+#include "opencv2/imgproc.hpp"
+
+#include <limits>
+
+namespace basalt {
+    /*
+     * Cheap image quality measures of a single camera frame. All of them are computed on a downsampled 8-bit copy of
+     * the image (see FrameQualityEstimator), so absolute values depend on the downsampling and are meant to be
+     * compared between frames of the same bag.
+     * */
+    struct FrameQuality {
+        double sharpness = 0.0;// variance of the Laplacian, low for blurred frames
+        double underexposed = 0.0;// fraction of pixels at or below FrameQualityEstimator::under_level
+        double overexposed = 0.0;// fraction of pixels at or above FrameQualityEstimator::over_level
+        double motion = -1.0;// mean absolute difference to the previous frame of the same camera, -1 if unknown
+    };
+
+    using FrameQualityMap = tbb::concurrent_unordered_map<TimeCamId, FrameQuality, std::hash<TimeCamId>>;
+
+    // A frame passes if it satisfies all thresholds, the defaults let everything pass
+    struct FrameQualityThresholds {
+        double min_sharpness = 0.0;
+        double max_underexposed = 1.0;
+        double max_overexposed = 1.0;
+        double max_motion = std::numeric_limits<double>::infinity();
+
+        bool pass(const FrameQuality &q) const {
+            return q.sharpness >= min_sharpness && q.underexposed <= max_underexposed &&
+                   q.overexposed <= max_overexposed && q.motion <= max_motion;
+        }
+    };
+
+    class FrameQualityEstimator {
+    public:
+        /*
+         * Computes the quality of img. small is set to the downsampled image that the scores were computed on, pass it
+         * as prev_small for the next frame of the same camera to get the motion score. An empty prev_small, or one of
+         * a different size, leaves motion at -1.
+         * */
+        FrameQuality compute(const basalt::Image<uint16_t> &img, cv::Mat &small, const cv::Mat &prev_small) const;
+
+        // Images are halved until they are at most this wide
+        int max_width = 320;
+        int under_level = 5;
+        int over_level = 250;
+    };
+
+    /*
+     * Returns the entries of corners whose frame passes the thresholds. Frames without a quality record are kept, so
+     * the filter never drops frames it knows nothing about.
+     * */
+    CalibCornerTable filter_corners_by_quality(const CalibCornerTable &corners, const FrameQualityMap &quality,
+                                               const FrameQualityThresholds &thresholds);
+}// namespace basalt
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "calibration/calibration_data.hpp"
+#include "calibration/corner_table.hpp"
+#include <basalt/utils/sophus_utils.hpp>
+
+#include <cstddef>
+
+namespace basalt {
+    struct FrameSelectionParams {
+        size_t frames_per_camera = 100;
+
+        // Image plane coverage grid, every cell counts until cell_capacity selected frames have a corner in it
+        int grid_cols = 16;
+        int grid_rows = 12;
+        int cell_capacity = 4;
+
+        /*
+         * Pose diversity, approximated from the image of the board: its apparent size, in-plane rotation and
+         * foreshortening. Every pose bin counts until pose_capacity selected frames fall into it, weighted by
+         * pose_weight relative to a single grid cell.
+         * */
+        int pose_capacity = 2;
+        double pose_weight = 8.0;
+
+        // Frames with fewer corners are never selected
+        size_t min_corners = 8;
+    };
+
+    /*
+     * Selects up to frames_per_camera frames of every camera that maximize the coverage of the image plane with
+     * corners and the diversity of board poses, and returns their entries of corners.
+     *
+     * The objective is a sum of concave (capped) functions of per-bin counts and thus submodular, so greedy selection
+     * is within (1 - 1/e) of the optimum. Lazy greedy evaluation keeps the cost close to linear in the number of
+     * frames. Cameras are selected independently of each other and in parallel.
+     *
+     * resolution is indexed by camera id. Cameras without a known resolution use the extent of their corners.
+     * */
+    CalibCornerTable select_frames(const CalibCornerTable &corners,
+                                   const Eigen::aligned_vector<Eigen::Vector2i> &resolution,
+                                   const FrameSelectionParams &params);
+}// namespace basalt
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "calibration/board_pose.hpp"
+#include "calibration/corner_table.hpp"
+
+#include <basalt/calibration/calibration.hpp>
+#include <basalt/utils/sophus_utils.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace basalt {
+    struct IntrinsicsSolverOptions {
+        int max_iterations = 50;
+
+        // Stops when an iteration lowers the cost by less than this fraction
+        double function_tolerance = 1e-9;
+
+        // Residuals above are down weighted (Huber loss) [px]
+        double huber_threshold = 2.0;
+
+        // Frames with fewer corners are not used, they hardly constrain their board pose
+        size_t min_corners = 8;
+
+        // A camera needs this many frames, otherwise its intrinsics are left at the initial guess
+        size_t min_frames = 3;
+
+        double initial_lambda = 1e-4;
+
+        // Initial poses of frames without one in the given CalibInitPoseMap
+        BoardPoseParams board_pose;
+    };
+
+    struct IntrinsicsResult {
+        GenericCamera<double> intrinsics;
+
+        // Pose of the camera in the target frame for every frame used, ordered by timestamp
+        std::vector<int64_t> timestamps;
+        Eigen::aligned_vector<Sophus::SE3d> T_a_c;
+
+        double initial_rms = 0;// reprojection error with the initial guess [px]
+        double rms = 0;        // reprojection error of the result [px]
+        size_t num_corners = 0;
+        int num_iterations = 0;
+        bool converged = false;
+    };
+
+    /*
+     * Calibrates camera intrinsics in process, from the detected corners of a planar target with known geometry.
+     *
+     * Every camera is solved on its own: its intrinsics and the target pose of every frame are refined together by
+     * minimizing the reprojection error with Levenberg-Marquardt. The camera models of basalt-headers (pinhole-radtan8,
+     * kb4, ds and the others of GenericCamera) provide the analytic Jacobians. Frames only share the intrinsics, so
+     * the normal equations are sparse: the 6x6 pose blocks are eliminated with the Schur complement and only the
+     * intrinsics are solved densely. Residuals and their Jacobians are evaluated in parallel over the frames.
+     *
+     * The initial guess are the intrinsics of a prior, e.g. a file in priors/. Initial poses are taken from a
+     * CalibInitPoseMap if given, e.g. dataset->calib_init_poses (see compute_init_poses). Frames without an entry in
+     * it, or all frames without a map, get theirs from estimate_board_pose. Frames for which that fails are not used.
+     * */
+    class IntrinsicsSolver {
+    public:
+        // board_corners are the corner positions of the target indexed by corner id, see aprilgrid_corners
+        explicit IntrinsicsSolver(const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                                  const IntrinsicsSolverOptions &options = IntrinsicsSolverOptions());
+
+        // Intrinsics of camera cam, starting from initial. init_poses must have been estimated with initial.
+        IntrinsicsResult solve(const CalibCornerTable &corners, size_t cam, const GenericCamera<double> &initial,
+                               const CalibInitPoseMap *init_poses = nullptr) const;
+
+        /*
+         * All cameras of prior, in parallel. Returns prior with the calibrated intrinsics, results receives the
+         * result of every camera if given. Throws std::invalid_argument if the corners are of more cameras than
+         * prior has.
+         * */
+        Calibration<double> solve(const CalibCornerTable &corners, const Calibration<double> &prior,
+                                  std::vector<IntrinsicsResult> *results = nullptr,
+                                  const CalibInitPoseMap *init_poses = nullptr) const;
+
+    private:
+        Eigen::aligned_vector<Eigen::Vector3d> board_corners;
+        IntrinsicsSolverOptions options;
+    };
+}// namespace basalt
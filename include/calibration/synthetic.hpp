@@ -0,0 +1,131 @@
+#pragma once
+
+#include "calibration/calibration_data.hpp"
+#include <basalt/calibration/calibration.hpp>
+#include <basalt/image/image.h>
+#include <basalt/utils/sophus_utils.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace basalt {
+    /*
+     * Calibration target with known geometry, for rendering synthetic data with ground truth.
+     *
+     * Corners and board frame are those of aprilgrid_corners and checkerboard_corners. A checkerboard looks the same
+     * rotated by 180 degrees, its ids only match a detection up to that symmetry.
+     * */
+    class SyntheticTarget {
+    public:
+        static SyntheticTarget aprilgrid(const AprilGrid &grid);
+
+        // cols x rows inner corners, squares of square_size [m]
+        static SyntheticTarget checkerboard(int cols, int rows, double square_size);
+
+        // Reflectance at (x, y) of the board plane, 0 is black and 1 white, negative off the board
+        float reflectance(double x, double y) const;
+
+        // Corner positions indexed by corner id
+        inline const Eigen::aligned_vector<Eigen::Vector3d> &get_corners() const { return this->corners; }
+
+        // "aprilgrid" or "checkerboard"
+        inline const std::string &get_target_type() const { return this->target_type; }
+
+        // Center of the corners, where the trajectory looks at
+        Eigen::Vector3d center() const;
+
+    private:
+        SyntheticTarget() = default;
+
+        std::string target_type;
+        bool is_checkerboard = false;
+        Eigen::aligned_vector<Eigen::Vector3d> corners;
+
+        // Printed area, [min_x, max_x] x [min_y, max_y] including the white margin
+        Eigen::Vector2d min_xy, max_xy;
+
+        // AprilGrid
+        int tag_cols = 0;
+        int tag_rows = 0;
+        double tag_size = 0;
+        double tag_pitch = 0;// tag size plus spacing
+        std::vector<unsigned long long> tag_codes;// codes of the tags on the board, in tag order
+        int tag_bits = 0;// data bits per side
+
+        // Checkerboard
+        int cb_cols = 0;
+        int cb_rows = 0;
+        double square_size = 0;
+    };
+
+    struct SyntheticConfig {
+        double duration = 10.0;   // [s]
+        double camera_rate = 20.0;// [Hz]
+        double imu_rate = 200.0;  // [Hz]
+
+        /*
+         * Trajectory of the first camera: it moves on sinusoids of up to amplitude [m] along every axis around a point
+         * distance [m] in front of the center of the target and looks at that center, rolling by up to max_angle
+         * [rad] around its optical axis and a quarter of that around the others. The other cameras follow through the
+         * extrinsics of the camera model.
+         * */
+        double distance = 1.0;
+        double amplitude = 0.3;
+        double max_angle = 0.4;
+
+        int supersampling = 2;   // samples per pixel along each axis
+        double blur_sigma = 0.0; // Gaussian blur [px], 0 for none
+        double noise_sigma = 2.0;// Gaussian noise [8 bit gray levels]
+
+        std::string encoding = "mono8";// mono8 or mono16
+        uint32_t seed = 42;
+    };
+
+    /*
+     * Renders a target through the cameras of a Calibration (e.g. a file in priors/) along the trajectory of a
+     * SyntheticConfig, and writes the images, IMU samples and ground truth poses to a rosbag.
+     *
+     * Unprojected rays of every camera are computed once, rendering a frame then is a plane intersection per sample.
+     * Frames are rendered in parallel, every frame uses its own noise seed so the output does not depend on the
+     * number of threads.
+     * */
+    class SyntheticRenderer {
+    public:
+        SyntheticRenderer(const SyntheticTarget &target, const Calibration<double> &calib,
+                          const SyntheticConfig &config);
+
+        // Pose of the IMU in the board frame at time t [s] since the start of the trajectory
+        Sophus::SE3d pose(double t) const;
+
+        size_t num_frames() const;
+
+        // Timestamp of a frame in the bag
+        int64_t frame_timestamp_ns(size_t frame) const;
+
+        // Time since the start of the trajectory of a bag timestamp [s]
+        double trajectory_time(int64_t timestamp_ns) const;
+
+        // Image of camera cam with the IMU at T_w_i, noise_seed selects the noise
+        ManagedImage<uint16_t> render(size_t cam, const Sophus::SE3d &T_w_i, uint32_t noise_seed) const;
+
+        // Ground truth corners of camera cam with the IMU at T_w_i, only those that project into the image
+        CalibCornerData project_corners(size_t cam, const Sophus::SE3d &T_w_i) const;
+
+        /*
+         * Writes /cam<i>/image_raw for every camera, /imu0 and the IMU poses as /gt/pose (geometry_msgs/PoseStamped,
+         * IMU in board frame). Timestamps start at 1 s. Returns the number of frames per camera.
+         * */
+        size_t write_bag(const std::string &path) const;
+
+        inline size_t get_num_cams() const { return this->calib.intrinsics.size(); }
+
+    private:
+        SyntheticTarget target;
+        Calibration<double> calib;
+        SyntheticConfig config;
+
+        // Unit rays of every sample of every camera, row major and supersampled, NaN where unprojection fails
+        std::vector<Eigen::aligned_vector<Eigen::Vector3f>> rays;
+    };
+}// namespace basalt
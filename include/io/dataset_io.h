@@ -2,6 +2,8 @@
 
 #include "utils/filesystem.h"
 #include "calibration/calibration_data.hpp"
+#include "calibration/corner_table.hpp"
+#include "calibration/frame_quality.hpp"
 
 #include <basalt/camera/generic_camera.hpp>
 #include <basalt/camera/stereographic_param.hpp>
@@ -35,6 +37,7 @@
 #include <sensor_msgs/Imu.h>
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <iomanip>
@@ -118,11 +121,18 @@ namespace basalt {
         std::vector<std::string> cam_topics;
         std::string imu_topic;
 
+        // width and height of every camera, from its first image
+        Eigen::aligned_vector<Eigen::Vector2i> resolution;
+
     public:
 
-        RosbagDataset(const std::string &path) {
+        /*
+         * convert_images fills image_data with 8-bit color copies of every frame for display, headless users that
+         * only run detection can skip that.
+         * */
+        RosbagDataset(const std::string &path, bool convert_images = true) {
             spdlog::debug("Creating rosbag dataset");
-            read(path);
+            read(path, convert_images);
         }
 
         ~RosbagDataset() {}
@@ -141,6 +151,8 @@ namespace basalt {
 
         std::vector<std::string> get_camera_names() { return cam_topics; }
 
+        const Eigen::aligned_vector<Eigen::Vector2i> &get_resolution() const { return resolution; }
+
         std::string get_imu_name() { return imu_topic; }
 
         std::vector<int64_t> &get_image_timestamps() { return image_timestamps; }
@@ -169,13 +181,14 @@ namespace basalt {
         // Store as public member, the move semantics gets confusing and alot of copies made
         // Use a mutex to protect access, once there are more threads, but for now there's only one so it
         // doesn't matter.
-        CalibCornerMap calib_corners;
-        CalibCornerMap calib_corners_rejected;
+        CalibCornerTable calib_corners;
+        CalibCornerTable calib_corners_rejected;
         CalibInitPoseMap calib_init_poses;
+        FrameQualityMap frame_quality;
 
         std::map<int64_t, std::vector<cv::Mat>> image_data; // corners will be drawn into memory for now
 
-        void read(const std::string &path) {
+        void read(const std::string &path, bool convert_images = true) {
             if (!fs::exists(path)) {
                 spdlog::error("No dataset found in {}", path);
             } else {
@@ -244,6 +257,7 @@ namespace basalt {
             }
 
             this->num_cams = cam_topics.size();
+            this->resolution.assign(this->num_cams, Eigen::Vector2i::Zero());
 
             int num_msgs = 0;
 
@@ -271,6 +285,11 @@ namespace basalt {
                     if (img_vec.size() == 0) img_vec.resize(this->num_cams);
 
                     img_vec[topic_to_id.at(topic)] = m.index_entry_;
+
+                    auto &res = this->resolution[topic_to_id.at(topic)];
+                    if (res.isZero()) {
+                        res = Eigen::Vector2i(img_msg->width, img_msg->height);
+                    }
                     image_timestamps.insert(timestamp_ns);
 
                     min_time = std::min(min_time, timestamp_ns);
@@ -404,6 +423,10 @@ namespace basalt {
                           min_time, max_time, this->mocap_to_imu_offset_ns);
             spdlog::debug("Number of mocap poses: {}", this->gt_timestamps.size());
 
+            if (!convert_images) {
+                return;
+            }
+
             // Section: Read the images and convert them to cv::Mat and store them in image_data
             for (auto ts : this->image_timestamps) {
                 std::vector<ImageData> raw_data = this->get_image_data(ts);
@@ -448,6 +471,11 @@ namespace basalt {
         }
 
         std::vector<ImageData> get_image_data(int64_t t_ns) {
+            return this->get_image_data(t_ns, 0, num_cams);
+        }
+
+        // Only decodes the images of cameras [cam_begin, cam_end), the others are left empty
+        std::vector<ImageData> get_image_data(int64_t t_ns, size_t cam_begin, size_t cam_end) {
             spdlog::debug("RosbagDataset::get_image_data");
             std::vector<ImageData> res(num_cams);
 
@@ -455,7 +483,7 @@ namespace basalt {
 
             if (it != image_data_idx.end()) {
 
-                for (size_t i = 0; i < num_cams; i++) {
+                for (size_t i = cam_begin; i < std::min(cam_end, num_cams); i++) {
                     ImageData &id = res[i];
 
                     if (!it->second[i].has_value()) {
@@ -23,7 +23,9 @@ namespace vk {
         BetterBag() : write_queue(1024), m_stop(false){ }
         ~BetterBag() {
             m_stop = true;
-            processing_thread.join();
+            if (processing_thread.joinable()) {
+                processing_thread.join();
+            }
             if (m_bag.isOpen()) {
                 m_bag.close();
             }
@@ -37,10 +39,12 @@ namespace vk {
 
         void close() {
             spdlog::trace("BetterBag::close");
-            // Need to ensure that the processing thread is finished writing
-            // Here, the write_queue may not be fully empty after closing.
+            // The processing thread drains the write_queue before it exits, so everything written before close()
+            // ends up in the bag
             m_stop = true;
-            processing_thread.join();
+            if (processing_thread.joinable()) {
+                processing_thread.join();
+            }
             spdlog::debug("Processing thread successfully joined");
             this->m_bag.close();
         }
@@ -57,7 +61,7 @@ namespace vk {
         void process_writes() {
             spdlog::debug("Starting write thread for bag file: {}", m_bag.getFileName());
             WriteData data;
-            while(!m_stop) {
+            while(!m_stop || !write_queue.empty()) {
                 if (!write_queue.empty()) {
                     data = *write_queue.front();
                     write_queue.pop();
@@ -5,6 +5,7 @@
 #include "utils/enum.h"
 #include <immvision.h>
 
+#include <atomic>
 #include <thread>
 
 // NOLINTNEXTLINE
@@ -24,9 +25,15 @@ private:
     void draw_cam_view();
 
     void detect_corners();
+    // The chosen detector backend, or the built-in one if it does not detect the selected target
+    std::string selected_detector() const;
     void draw_corners();
     void launch_vkcalibrate(std::string dataset_path, std::string cb_path,
                                                 std::string result_path, std::vector<std::string> cam_types);
+    // Calibrates the intrinsics of the selected bag in process, starting from the cameras of prior_path
+    void calibrate_intrinsics(std::string prior_path, std::string result_path);
+    // Detection tasks that have not finished writing calib_corners yet
+    std::atomic<int> detections_running{0};
     bool show_corners = false;
     bool show_corners_rejected = false;
     int selected_rosbag = 0;
@@ -37,6 +44,13 @@ private:
     ImmVision::ImageParams image_params;
 
     DetectionType detection_type = DetectionType::Checkerboard;
+    // Backend name in the DetectorRegistry
+    std::string detector;
+    // Seed each frame's search region from the previous frame's corners
+    bool roi_tracking;
+    // Skip frames without a plausible board before running the detector
+    bool prefilter;
+
     // Checkerboard
     int cb_width;
     int cb_height;
@@ -49,6 +63,7 @@ private:
     bool filter_quads;
     bool fast_check;
     bool enable_subpix_refine;
+    int pyramid_level;
 
     // Member variables pertaining to launching vk_calibrate
     std::vector<std::string> cam_types;
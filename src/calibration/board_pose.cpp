@@ -0,0 +1,344 @@
+#include "calibration/board_pose.hpp"
+
+#include <tbb/blocked_range2d.h>
+#include <tbb/parallel_for.h>
+
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace basalt {
+    namespace {
+        // Corners of a homography hypothesis
+        constexpr int SAMPLE_SIZE = 4;
+
+        struct Correspondence {
+            Eigen::Vector3d p_a;  // corner in the target frame
+            Eigen::Vector2d image;// unprojected corner on the z = 1 plane
+            Eigen::Vector2d uv;   // detected corner [px]
+        };
+
+        // Similarity that moves the centroid of pts to the origin and their mean distance to sqrt(2)
+        template<class Get>
+        Eigen::Matrix3d normalization(const std::vector<Correspondence> &pts, const Get &get) {
+            Eigen::Vector2d mean = Eigen::Vector2d::Zero();
+            for (const auto &p: pts) {
+                mean += get(p);
+            }
+            mean /= static_cast<double>(pts.size());
+
+            double dist = 0;
+            for (const auto &p: pts) {
+                dist += (get(p) - mean).norm();
+            }
+            const double s = std::sqrt(2.0) * static_cast<double>(pts.size()) / std::max(dist, 1e-12);
+
+            Eigen::Matrix3d T;
+            T << s, 0, -s * mean.x(), 0, s, -s * mean.y(), 0, 0, 1;
+            return T;
+        }
+
+        // Homographies are estimated on normalized coordinates (Hartley), shared by all hypotheses of an image
+        struct Normalization {
+            Eigen::Matrix3d T_plane;
+            Eigen::Matrix3d T_image;
+        };
+
+        // Homography from the target plane to the z = 1 plane of the camera (DLT) of the corners at indices
+        template<class Indices>
+        Eigen::Matrix3d fit_homography(const std::vector<Correspondence> &pts, const Indices &indices,
+                                       const Normalization &norm) {
+            Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero();
+            for (const size_t i: indices) {
+                const Eigen::Vector3d X = norm.T_plane * pts[i].p_a.head<2>().homogeneous();
+                const Eigen::Vector3d x = norm.T_image * pts[i].image.homogeneous();
+
+                Eigen::Matrix<double, 2, 9> A;
+                A << -X.x(), -X.y(), -1, 0, 0, 0, x.x() * X.x(), x.x() * X.y(), x.x(),
+                        0, 0, 0, -X.x(), -X.y(), -1, x.y() * X.x(), x.y() * X.y(), x.y();
+                AtA += A.transpose() * A;
+            }
+
+            // Null vector of A, the eigenvector of the smallest eigenvalue
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> eig(AtA);
+            const Eigen::Matrix<double, 9, 1> h = eig.eigenvectors().col(0);
+            Eigen::Matrix3d H;
+            H << h(0), h(1), h(2), h(3), h(4), h(5), h(6), h(7), h(8);
+            return norm.T_image.inverse() * H * norm.T_plane;
+        }
+
+        // H is [r1 r2 t] up to scale, with the target in front of the camera
+        Sophus::SE3d pose_from_homography(const Eigen::Matrix3d &H) {
+            double scale = 2.0 / std::max(H.col(0).norm() + H.col(1).norm(), 1e-12);
+            if (H(2, 2) < 0) {
+                scale = -scale;
+            }
+
+            Eigen::Matrix3d R;
+            R.col(0) = scale * H.col(0);
+            R.col(1) = scale * H.col(1);
+            R.col(2) = R.col(0).cross(R.col(1));
+
+            // Closest rotation
+            Eigen::JacobiSVD<Eigen::Matrix3d> svd(R, Eigen::ComputeFullU | Eigen::ComputeFullV);
+            R = svd.matrixU() * svd.matrixV().transpose();
+            if (R.determinant() < 0) {
+                Eigen::Matrix3d U = svd.matrixU();
+                U.col(2) *= -1;
+                R = U * svd.matrixV().transpose();
+            }
+
+            return Sophus::SE3d(R, scale * H.col(2));
+        }
+
+        // Three corners of a sample on a line, e.g. on one row of the board, do not determine a homography
+        bool degenerate(const std::vector<Correspondence> &pts, const size_t (&sample)[SAMPLE_SIZE]) {
+            for (int i = 0; i < SAMPLE_SIZE; i++) {
+                for (int j = i + 1; j < SAMPLE_SIZE; j++) {
+                    for (int k = j + 1; k < SAMPLE_SIZE; k++) {
+                        const Eigen::Vector2d a = pts[sample[j]].p_a.head<2>() - pts[sample[i]].p_a.head<2>();
+                        const Eigen::Vector2d b = pts[sample[k]].p_a.head<2>() - pts[sample[i]].p_a.head<2>();
+                        if (std::abs(a.x() * b.y() - a.y() * b.x()) <= 1e-6 * a.norm() * b.norm()) {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        }
+
+        // The camera models only take the type of the Jacobian pointer into account, it must not be null
+        template<class Cam, class DerivedJ = std::nullptr_t>
+        inline bool project(const Cam &cam, const Eigen::Vector3d &p_c, Eigen::Vector2d &proj,
+                            DerivedJ d_proj_d_p = nullptr) {
+            return p_c.z() > 0 && cam.project(Eigen::Vector4d(p_c.x(), p_c.y(), p_c.z(), 1.0), proj, d_proj_d_p);
+        }
+
+        // Marks the corners that T_c_a reprojects within the inlier threshold, returns their number
+        template<class Cam>
+        size_t find_inliers(const Cam &cam, const std::vector<Correspondence> &pts, const Sophus::SE3d &T_c_a,
+                            double sq_threshold, std::vector<uint8_t> &inliers) {
+            size_t num_inliers = 0;
+            for (size_t i = 0; i < pts.size(); i++) {
+                Eigen::Vector2d proj;
+                inliers[i] = project(cam, T_c_a * pts[i].p_a, proj) && (proj - pts[i].uv).squaredNorm() <= sq_threshold;
+                num_inliers += inliers[i];
+            }
+            return num_inliers;
+        }
+
+        // Squared reprojection error of the inliers, num_projected counts those in front of the camera
+        template<class Cam>
+        double reprojection_cost(const Cam &cam, const std::vector<Correspondence> &pts,
+                                 const std::vector<uint8_t> &inliers, const Sophus::SE3d &T_c_a,
+                                 size_t &num_projected) {
+            double cost = 0;
+            num_projected = 0;
+            for (size_t i = 0; i < pts.size(); i++) {
+                Eigen::Vector2d proj;
+                if (inliers[i] && project(cam, T_c_a * pts[i].p_a, proj)) {
+                    cost += (proj - pts[i].uv).squaredNorm();
+                    num_projected++;
+                }
+            }
+            return cost;
+        }
+
+        // Gauss-Newton on the reprojection error of the inliers, poses are updated as exp(inc) * T_c_a
+        template<class Cam>
+        void refine_pose(const Cam &cam, const std::vector<Correspondence> &pts, const std::vector<uint8_t> &inliers,
+                         int iterations, Sophus::SE3d &T_c_a) {
+            size_t num_projected;
+            double cost = reprojection_cost(cam, pts, inliers, T_c_a, num_projected);
+
+            for (int it = 0; it < iterations; it++) {
+                Eigen::Matrix<double, 6, 6> H = Eigen::Matrix<double, 6, 6>::Zero();
+                Eigen::Matrix<double, 6, 1> b = Eigen::Matrix<double, 6, 1>::Zero();
+                for (size_t i = 0; i < pts.size(); i++) {
+                    const Eigen::Vector3d p_c = T_c_a * pts[i].p_a;
+                    Eigen::Vector2d proj;
+                    Eigen::Matrix<double, 2, 4> d_proj_d_p;
+                    if (!inliers[i] || !project(cam, p_c, proj, &d_proj_d_p)) {
+                        continue;
+                    }
+
+                    Eigen::Matrix<double, 2, 6> d_proj_d_pose;
+                    d_proj_d_pose.leftCols<3>() = d_proj_d_p.leftCols<3>();
+                    d_proj_d_pose.rightCols<3>() = -d_proj_d_p.leftCols<3>() * Sophus::SO3d::hat(p_c);
+                    H += d_proj_d_pose.transpose() * d_proj_d_pose;
+                    b += d_proj_d_pose.transpose() * (proj - pts[i].uv);
+                }
+
+                const Sophus::SE3d T_c_a_new = Sophus::SE3d::exp(-H.ldlt().solve(b)) * T_c_a;
+                size_t new_num_projected;
+                const double new_cost = reprojection_cost(cam, pts, inliers, T_c_a_new, new_num_projected);
+
+                // Corners that stop projecting would lower the cost without a better fit
+                if (!(new_cost < cost) || new_num_projected < num_projected) {
+                    break;
+                }
+                const double decrease = (cost - new_cost) / std::max(cost, 1e-30);
+                T_c_a = T_c_a_new;
+                cost = new_cost;
+                if (decrease < 1e-10) {
+                    break;
+                }
+            }
+        }
+
+        template<class Cam>
+        bool estimate(const Cam &cam, const std::vector<Correspondence> &pts,
+                      const Eigen::aligned_vector<Eigen::Vector3d> &board_corners, const BoardPoseParams &params,
+                      uint64_t seed, CalibInitPoseData &pose) {
+            const size_t n = pts.size();
+            const double sq_threshold = params.inlier_threshold * params.inlier_threshold;
+
+            Normalization norm;
+            norm.T_plane = normalization(pts, [](const Correspondence &c) { return c.p_a.head<2>(); });
+            norm.T_image = normalization(pts, [](const Correspondence &c) { return c.image; });
+
+            std::mt19937_64 rng(seed);
+            std::uniform_int_distribution<size_t> uniform(0, n - 1);
+
+            std::vector<uint8_t> inliers(n), best_inliers(n);
+            size_t best_num_inliers = 0;
+            Sophus::SE3d T_c_a;
+
+            int needed_iterations = params.max_iterations;
+            for (int it = 0; it < needed_iterations; it++) {
+                size_t sample[SAMPLE_SIZE];
+                for (int k = 0; k < SAMPLE_SIZE; k++) {
+                    do {
+                        sample[k] = uniform(rng);
+                    } while (std::find(sample, sample + k, sample[k]) != sample + k);
+                }
+                if (degenerate(pts, sample)) {
+                    continue;
+                }
+
+                const Sophus::SE3d T_c_a_sample = pose_from_homography(fit_homography(pts, sample, norm));
+                const size_t num_inliers = find_inliers(cam, pts, T_c_a_sample, sq_threshold, inliers);
+                if (num_inliers <= best_num_inliers) {
+                    continue;
+                }
+                best_num_inliers = num_inliers;
+                T_c_a = T_c_a_sample;
+                std::swap(inliers, best_inliers);
+
+                // Iterations after which a sample of inliers only has been drawn with the required confidence
+                const double p_sample = std::pow(static_cast<double>(num_inliers) / static_cast<double>(n),
+                                                 SAMPLE_SIZE);
+                if (p_sample >= 1.0 - 1e-12) {
+                    break;
+                }
+                const double k = std::log(1.0 - params.confidence) / std::log(1.0 - p_sample);
+                needed_iterations = static_cast<int>(std::min<double>(params.max_iterations, std::ceil(k)));
+            }
+
+            if (best_num_inliers < std::max<size_t>(SAMPLE_SIZE, params.min_inliers)) {
+                return false;
+            }
+
+            // Refit to all inliers of the best hypothesis, keep it unless that loses inliers
+            std::vector<size_t> inlier_indices;
+            for (size_t i = 0; i < n; i++) {
+                if (best_inliers[i]) {
+                    inlier_indices.push_back(i);
+                }
+            }
+            const Sophus::SE3d T_c_a_refit = pose_from_homography(fit_homography(pts, inlier_indices, norm));
+            const size_t num_refit_inliers = find_inliers(cam, pts, T_c_a_refit, sq_threshold, inliers);
+            if (num_refit_inliers >= best_num_inliers) {
+                T_c_a = T_c_a_refit;
+                std::swap(inliers, best_inliers);
+            }
+
+            refine_pose(cam, pts, best_inliers, params.refine_iterations, T_c_a);
+
+            const size_t num_inliers = find_inliers(cam, pts, T_c_a, sq_threshold, inliers);
+            if (num_inliers < params.min_inliers) {
+                return false;
+            }
+
+            pose.T_a_c = T_c_a.inverse();
+            pose.num_inliers = num_inliers;
+            pose.reprojected_corners.resize(board_corners.size());
+            for (size_t i = 0; i < board_corners.size(); i++) {
+                if (!project(cam, T_c_a * board_corners[i], pose.reprojected_corners[i])) {
+                    pose.reprojected_corners[i].setConstant(std::numeric_limits<double>::quiet_NaN());
+                }
+            }
+            return true;
+        }
+    }// namespace
+
+    bool estimate_board_pose(const GenericCamera<double> &cam,
+                             const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                             const CompactCornerData &corners, const BoardPoseParams &params, uint64_t seed,
+                             CalibInitPoseData &pose) {
+        std::vector<Correspondence> pts;
+        pts.reserve(corners.size());
+        for (size_t i = 0; i < corners.size(); i++) {
+            const size_t id = static_cast<size_t>(corners.id(i));
+            Eigen::Vector4d ray;
+            if (id < board_corners.size() && cam.unproject(corners.corner(i), ray) && ray.z() > 1e-6) {
+                pts.push_back({board_corners[id], ray.head<2>() / ray.z(), corners.corner(i)});
+            }
+        }
+        if (pts.size() < std::max<size_t>(SAMPLE_SIZE, params.min_inliers)) {
+            return false;
+        }
+
+        return std::visit(
+                [&](const auto &concrete_cam) {
+                    return estimate(concrete_cam, pts, board_corners, params, seed, pose);
+                },
+                cam.variant);
+    }
+
+    size_t compute_init_poses(const CalibCornerTable &corners, const Calibration<double> &calib,
+                              const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                              const BoardPoseParams &params, CalibInitPoseMap &init_poses) {
+        if (corners.get_num_cams() > calib.intrinsics.size()) {
+            throw std::invalid_argument("corners of " + std::to_string(corners.get_num_cams()) +
+                                        " cameras, but the calibration has " +
+                                        std::to_string(calib.intrinsics.size()));
+        }
+
+        init_poses.clear();
+        std::atomic<size_t> num_poses{0};
+
+        // Images are independent of each other, their RANSAC samples only depend on their seed
+        tbb::parallel_for(
+                tbb::blocked_range2d<size_t>(0, corners.get_num_frames(), 0, corners.get_num_cams()),
+                [&](const tbb::blocked_range2d<size_t> &r) {
+                    for (size_t j = r.rows().begin(); j != r.rows().end(); ++j) {
+                        for (size_t i = r.cols().begin(); i != r.cols().end(); ++i) {
+                            const CompactCornerData *ccd = corners.get(j, i);
+                            if (!ccd) {
+                                continue;
+                            }
+
+                            const TimeCamId tcid(corners.get_timestamps()[j], i);
+                            CalibInitPoseData pose;
+                            if (estimate_board_pose(calib.intrinsics[i], board_corners, *ccd, params,
+                                                    std::hash<TimeCamId>()(tcid), pose)) {
+                                init_poses.emplace(tcid, std::move(pose));
+                                num_poses++;
+                            }
+                        }
+                    }
+                });
+
+        return num_poses;
+    }
+}// namespace basalt
@@ -0,0 +1,62 @@
+#include "calibration/calibration_data.hpp"
+
+#include <cereal/archives/json.hpp>
+
+#include <fstream>
+#include <stdexcept>
+
+namespace basalt {
+    Calibration<double> load_calibration(const std::string &path) {
+        std::ifstream is(path);
+        if (!is.is_open()) {
+            throw std::runtime_error("could not open camera model " + path);
+        }
+
+        Calibration<double> calib;
+        try {
+            cereal::JSONInputArchive archive(is);
+            archive(calib);
+        } catch (const cereal::Exception &e) {
+            throw std::runtime_error("could not read camera model " + path + ": " + e.what());
+        }
+        if (calib.intrinsics.empty()) {
+            throw std::runtime_error("camera model " + path + " has no cameras");
+        }
+        return calib;
+    }
+
+    Eigen::aligned_vector<Eigen::Vector3d> aprilgrid_corners(const AprilGrid &grid) {
+        const double tag_size = grid.getTagSize();
+        const double tag_pitch = tag_size * (1.0 + grid.getTagSpacing());
+
+        // Same corner order as the detector reports, see apriltag.cpp
+        const double x_offsets[4] = {0, tag_size, tag_size, 0};
+        const double y_offsets[4] = {0, 0, tag_size, tag_size};
+
+        Eigen::aligned_vector<Eigen::Vector3d> corners;
+        corners.reserve(4 * grid.getTagCols() * grid.getTagRows());
+        for (int ty = 0; ty < grid.getTagRows(); ty++) {
+            for (int tx = 0; tx < grid.getTagCols(); tx++) {
+                for (int k = 0; k < 4; k++) {
+                    corners.emplace_back(tx * tag_pitch + x_offsets[k], ty * tag_pitch + y_offsets[k], 0.0);
+                }
+            }
+        }
+        return corners;
+    }
+
+    Eigen::aligned_vector<Eigen::Vector3d> checkerboard_corners(int cols, int rows, double square_size) {
+        if (cols < 2 || rows < 2 || square_size <= 0) {
+            throw std::invalid_argument("checkerboard needs at least 2x2 inner corners and a positive square size");
+        }
+
+        Eigen::aligned_vector<Eigen::Vector3d> corners;
+        corners.reserve(cols * rows);
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                corners.emplace_back(c * square_size, r * square_size, 0.0);
+            }
+        }
+        return corners;
+    }
+}// namespace basalt
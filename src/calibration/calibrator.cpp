@@ -1,5 +1,11 @@
 #include "calibration/calibrator.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
 //namespace basalt {
 //    void AprilGridParams::process(basalt::ManagedImage<uint16_t> &img_raw, CalibCornerData &ccd_good, CalibCornerData &ccd_bad) {
 //        ad.detectTags(img_raw, ccd_good.corners,
@@ -111,26 +117,189 @@
 //}// namespace basalt
 
 namespace basalt {
-    void AprilGridParams::process(basalt::ManagedImage<uint16_t> &img_raw, CalibCornerData &ccd_good, CalibCornerData &ccd_bad) {
-        ad.detectTags(img_raw, ccd_good.corners,
+    // Clips roi to the image, an empty roi selects the full image
+    static cv::Rect clip_roi(const cv::Rect &roi, const basalt::ManagedImage<uint16_t> &img_raw) {
+        const cv::Rect full(0, 0, static_cast<int>(img_raw.w), static_cast<int>(img_raw.h));
+        return roi.empty() ? full : (roi & full);
+    }
+
+    static void offset_corners(CalibCornerData &ccd, const cv::Point &offset) {
+        for (auto &c : ccd.corners) {
+            c[0] += offset.x;
+            c[1] += offset.y;
+        }
+    }
+
+    void CalibParams::process_batch(const std::vector<basalt::ManagedImage<uint16_t>::Ptr> &imgs,
+                                    std::vector<CalibCornerData> &good, std::vector<CalibCornerData> &bad) {
+        good.assign(imgs.size(), CalibCornerData());
+        bad.assign(imgs.size(), CalibCornerData());
+
+        for (size_t i = 0; i < imgs.size(); i++) {
+            if (imgs[i]) {
+                this->process(*imgs[i], good[i], bad[i]);
+            }
+        }
+    }
+
+    cv::Rect CalibParams::tracking_roi(const CalibCornerData &ccd, const cv::Size &img_size) const {
+        if (ccd.corners.empty()) {
+            return {};
+        }
+
+        Eigen::Vector2d min_c = ccd.corners[0];
+        Eigen::Vector2d max_c = ccd.corners[0];
+        for (const auto &c : ccd.corners) {
+            min_c = min_c.cwiseMin(c);
+            max_c = max_c.cwiseMax(c);
+        }
+
+        const Eigen::Vector2d size = max_c - min_c;
+        const double pad_x = std::max<double>(this->roi_min_padding, this->roi_padding_ratio * size[0]);
+        const double pad_y = std::max<double>(this->roi_min_padding, this->roi_padding_ratio * size[1]);
+
+        const int x0 = static_cast<int>(std::floor(min_c[0] - pad_x));
+        const int y0 = static_cast<int>(std::floor(min_c[1] - pad_y));
+        const int x1 = static_cast<int>(std::ceil(max_c[0] + pad_x));
+        const int y1 = static_cast<int>(std::ceil(max_c[1] + pad_y));
+
+        return cv::Rect(x0, y0, x1 - x0, y1 - y0) & cv::Rect(cv::Point(0, 0), img_size);
+    }
+
+    bool CalibParams::board_likely(const basalt::ManagedImage<uint16_t> &img_raw) const {
+        // Nearest neighbour subsampling to roughly 160 px width, a board that is detectable at full resolution still
+        // covers a good number of samples
+        const size_t step = std::max<size_t>(1, img_raw.w / 160);
+        const size_t w = img_raw.w / step;
+        const size_t h = img_raw.h / step;
+        if (w < 3 || h < 3) {
+            return true;
+        }
+
+        thread_local std::vector<uint8_t> small;
+        small.resize(w * h);
+
+        std::array<uint32_t, 256> hist{};
+        for (size_t y = 0; y < h; y++) {
+            const uint16_t *row = img_raw.RowPtr(y * step);
+            uint8_t *dst = &small[y * w];
+            for (size_t x = 0; x < w; x++) {
+                dst[x] = static_cast<uint8_t>(row[x * step] >> 8);
+                hist[dst[x]]++;
+            }
+        }
+
+        // Robust contrast, a board always has both black and white squares in view
+        const size_t n = w * h;
+        int lo = -1, hi = 0;
+        size_t cum = 0;
+        for (int v = 0; v < 256; v++) {
+            cum += hist[v];
+            if (lo < 0 && cum > n / 20) {
+                lo = v;
+            }
+            if (cum <= n - n / 20) {
+                hi = v;
+            }
+        }
+        const int contrast = hi - lo;
+        if (contrast < this->prefilter_min_contrast * 255.0) {
+            return false;
+        }
+
+        // Gradient energy, the square edges give strong gradients relative to the contrast of the image
+        const int edge_thresh = std::max(8, contrast / 4);
+        size_t num_edges = 0;
+        for (size_t y = 1; y + 1 < h; y++) {
+            const uint8_t *r0 = &small[(y - 1) * w];
+            const uint8_t *r1 = &small[y * w];
+            const uint8_t *r2 = &small[(y + 1) * w];
+            for (size_t x = 1; x + 1 < w; x++) {
+                const int gx = std::abs(r1[x + 1] - r1[x - 1]);
+                const int gy = std::abs(r2[x] - r0[x]);
+                num_edges += (gx + gy) > edge_thresh;
+            }
+        }
+
+        return num_edges >= this->prefilter_min_edge_fraction * static_cast<double>(n);
+    }
+
+    void AprilGridParams::process_roi(basalt::ManagedImage<uint16_t> &img_raw, const cv::Rect &roi,
+                                      CalibCornerData &ccd_good, CalibCornerData &ccd_bad) {
+        const cv::Rect r = clip_roi(roi, img_raw);
+
+        // View into the raw image, no copy
+        const basalt::Image<uint16_t> img_roi(img_raw.RowPtr(r.y) + r.x, r.width, r.height, img_raw.pitch);
+
+        ad.detectTags(img_roi, ccd_good.corners,
                       ccd_good.corner_ids, ccd_good.radii,
                       ccd_bad.corners, ccd_bad.corner_ids, ccd_bad.radii);
+
+        offset_corners(ccd_good, r.tl());
+        offset_corners(ccd_bad, r.tl());
+    }
+
+    std::string AprilGridParams::getTargetKey() const {
+        return this->getTargetType() + " " + std::to_string(this->april_grid->getTagRows()) + "x" +
+               std::to_string(this->april_grid->getTagCols()) + " " + std::to_string(this->april_grid->getTagSize()) +
+               " " + std::to_string(this->april_grid->getTagSpacing()) + " " + this->april_grid->getTagFamily() + " " +
+               std::to_string(this->april_grid->getLowId());
+    }
+
+    int AprilGridParams::auto_quad_decimate(const AprilGrid &grid, const Calibration<double> &calib,
+                                            double max_distance) {
+        if (calib.intrinsics.empty() || max_distance <= 0) {
+            throw std::invalid_argument("quad decimation needs a camera model and a positive target distance");
+        }
+
+        // Projecting the tag edges works for every camera model
+        const double half = 0.5 * grid.getTagSize();
+        double tag_px = std::numeric_limits<double>::max();
+        for (const auto &cam: calib.intrinsics) {
+            Eigen::Vector2d left, right;
+            if (!cam.project(Eigen::Vector4d(-half, 0, max_distance, 1), left) ||
+                !cam.project(Eigen::Vector4d(half, 0, max_distance, 1), right)) {
+                return 1;
+            }
+            tag_px = std::min(tag_px, (right - left).norm());
+        }
+
+        return std::clamp(static_cast<int>(tag_px / MIN_DECIMATED_TAG_PX), 1, MAX_QUAD_DECIMATE);
+    }
+
+
+    std::string OpenCVCheckerboardParams::getTargetKey() const {
+        return this->getTargetType() + " " + std::to_string(this->width) + "x" + std::to_string(this->height);
     }
 
+    void OpenCVCheckerboardParams::process_roi(basalt::ManagedImage<uint16_t> &img_raw, const cv::Rect &roi,
+                                               basalt::CalibCornerData &ccd_good, basalt::CalibCornerData &ccd_bad) {
+        const cv::Rect r = clip_roi(roi, img_raw);
 
-    void OpenCVCheckerboardParams::process(basalt::ManagedImage<uint16_t> &img_raw, basalt::CalibCornerData &ccd_good, basalt::CalibCornerData &ccd_bad) {
-        cv::Mat image16(img_raw.h, img_raw.w, CV_16U, img_raw.ptr);
+        cv::Mat image16(img_raw.h, img_raw.w, CV_16U, img_raw.ptr, img_raw.pitch);
         cv::Mat gray8;
-        image16.convertTo(gray8, CV_8U, 1.0 / 256.0);
+        image16(r).convertTo(gray8, CV_8U, 1.0 / 256.0);
 
         std::vector<cv::Point2f> corners;
 
         auto pattern_size = cv::Size(this->width, this->height);
 
-        bool patternfound = findChessboardCornersSB(gray8, pattern_size, corners, cv::CALIB_CB_EXHAUSTIVE | cv::CALIB_CB_ACCURACY);
+        bool patternfound;
+        if (this->pyramid_level > 0) {
+            // Corners are already refined at full resolution
+            patternfound = this->find_corners_coarse(gray8, corners);
+        } else {
+            // The sector based detector only understands NORMALIZE_IMAGE of the user flags, FAST_CHECK is done upfront
+            // since a failing exhaustive search is the most expensive case
+            patternfound = !(this->flags & cv::CALIB_CB_FAST_CHECK) || cv::checkChessboard(gray8, pattern_size);
+            patternfound = patternfound &&
+                           cv::findChessboardCornersSB(gray8, pattern_size, corners,
+                                                       cv::CALIB_CB_EXHAUSTIVE | cv::CALIB_CB_ACCURACY |
+                                                               (this->flags & cv::CALIB_CB_NORMALIZE_IMAGE));
+        }
 
         if (patternfound) {
-            if (this->enable_subpix_refine) {
+            if (this->enable_subpix_refine && this->pyramid_level == 0) {
                 cornerSubPix(gray8, corners, cv::Size(5,5), cv::Size(-1, -1), cv::TermCriteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 40, 0.001));
             }
 
@@ -153,60 +322,272 @@ namespace basalt {
             }
 
             ccd_good = CalibCornerData(corners);
+            offset_corners(ccd_good, r.tl());
         } else {
             ccd_bad = CalibCornerData(corners);
+            offset_corners(ccd_bad, r.tl());
         }
     }
 
 
 
+    bool OpenCVCheckerboardParams::find_corners_coarse(const cv::Mat &gray8, std::vector<cv::Point2f> &corners) const {
+        const auto pattern_size = cv::Size(this->width, this->height);
+        const double scale = static_cast<double>(1 << this->pyramid_level);
+
+        cv::Mat coarse;
+        cv::resize(gray8, coarse, cv::Size(), 1.0 / scale, 1.0 / scale, cv::INTER_AREA);
+
+        // The classic detector is much cheaper than the sector based one and does honor all of the user flags
+        if (!cv::findChessboardCorners(coarse, pattern_size, corners, this->flags)) {
+            return false;
+        }
+
+        // Pixel centers of the coarse level map to scale * (p + 0.5) - 0.5 at full resolution
+        for (auto &c : corners) {
+            c.x = static_cast<float>(scale * (c.x + 0.5) - 0.5);
+            c.y = static_cast<float>(scale * (c.y + 0.5) - 0.5);
+        }
+
+        // The refinement window has to cover the coarse localization error, but must stay within one square so that
+        // it doesn't snap to a neighbouring corner
+        float min_spacing = std::numeric_limits<float>::max();
+        for (int row = 0; row < pattern_size.height; row++) {
+            for (int col = 1; col < pattern_size.width; col++) {
+                const int idx = row * pattern_size.width + col;
+                min_spacing = std::min(min_spacing, static_cast<float>(cv::norm(corners[idx] - corners[idx - 1])));
+            }
+        }
+        const int half_win = std::max(2, std::min(static_cast<int>(0.4f * min_spacing),
+                                                  4 * static_cast<int>(scale)));
+
+        cv::cornerSubPix(gray8, corners, cv::Size(half_win, half_win), cv::Size(-1, -1),
+                         cv::TermCriteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 40, 0.001));
+        return true;
+    }
+
+
     Calibrator::Calibrator(const std::shared_ptr<RosbagDataset> &dataset) {
         const fs::path temp = dataset->get_file_path();
-        this->cache_path = temp.parent_path() / "calib-cam_detected_corners.cereal";
+        this->cache_path = temp.parent_path() / "calib-cam_detected_corners.corners";
+        this->json_path = temp.parent_path() / "calib-cam_detected_corners.json";
         this->dataset = dataset;
     }
 
 
+    std::vector<cv::Mat> Calibrator::motionReference(size_t j, size_t cam_begin, size_t cam_end) {
+        std::vector<cv::Mat> prev_small(this->dataset->get_num_cams());
+        if (j == 0) {
+            return prev_small;
+        }
+
+        const std::vector<ImageData> img_vec =
+                this->dataset->get_image_data(this->dataset->get_image_timestamps()[j - 1], cam_begin, cam_end);
+        for (size_t i = cam_begin; i < cam_end; i++) {
+            if (img_vec[i].img) {
+                this->quality_estimator.compute(*img_vec[i].img, prev_small[i], cv::Mat());
+            }
+        }
+        return prev_small;
+    }
+
+    void Calibrator::updateFrameQuality(const TimeCamId &tcid, const ManagedImage<uint16_t>::Ptr &img,
+                                        cv::Mat &prev_small) {
+        if (!img) {
+            prev_small = cv::Mat();
+            return;
+        }
+
+        cv::Mat small;
+        this->dataset->frame_quality.emplace(tcid, this->quality_estimator.compute(*img, small, prev_small));
+        prev_small = small;
+    }
+
+    void Calibrator::computeFrameQuality() {
+        this->dataset->frame_quality.clear();
+
+        const auto &timestamps = this->dataset->get_image_timestamps();
+
+        // Grain size amortizes decoding the motion reference of every chunk, cameras are independent
+        tbb::parallel_for(
+                tbb::blocked_range2d<size_t>(0, timestamps.size(), 16, 0, this->dataset->get_num_cams(), 1),
+                [&](const tbb::blocked_range2d<size_t> &r) {
+                    const size_t cam_begin = r.cols().begin();
+                    const size_t cam_end = r.cols().end();
+                    std::vector<cv::Mat> prev_small = this->motionReference(r.rows().begin(), cam_begin, cam_end);
+
+                    for (size_t j = r.rows().begin(); j != r.rows().end(); ++j) {
+                        const std::vector<ImageData> img_vec =
+                                this->dataset->get_image_data(timestamps[j], cam_begin, cam_end);
+                        for (size_t i = cam_begin; i != cam_end; i++) {
+                            this->updateFrameQuality(TimeCamId(timestamps[j], i), img_vec[i].img, prev_small[i]);
+                        }
+                    }
+                });
+
+        spdlog::debug("Computed quality of {} images", this->dataset->frame_quality.size());
+    }
+
+    void Calibrator::computeInitPoses(const Calibration<double> &calib,
+                                      const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                                      const BoardPoseParams &params) {
+        const size_t num_poses = compute_init_poses(this->dataset->calib_corners, calib, board_corners, params,
+                                                    this->dataset->calib_init_poses);
+
+        spdlog::info("Estimated initial target poses of {} of {} images", num_poses,
+                     this->dataset->calib_corners.size());
+    }
+
     void Calibrator::detectCorners(const std::shared_ptr<CalibParams> &params) {
-        if (this->loadCache()) {
+        // Estimated from the previous corners
+        this->dataset->calib_init_poses.clear();
+
+        if (this->loadCache(*params)) {
+            if (this->frame_quality) {
+                this->computeFrameQuality();
+            } else {
+                this->dataset->frame_quality.clear();
+            }
             return;
         } else {
             spdlog::trace("No cached corners found, running corner detection");
 
-            this->dataset->calib_corners.clear();
-            this->dataset->calib_corners_rejected.clear();
+            const size_t num_cams = this->dataset->get_num_cams();
+
+            // Every image gets its slot upfront, the parallel loop below only fills them
+            this->dataset->calib_corners.reset(this->dataset->get_image_timestamps(), num_cams);
+            this->dataset->calib_corners_rejected.reset(this->dataset->get_image_timestamps(), num_cams);
+            this->dataset->frame_quality.clear();
+
+            const bool roi_tracking = params->get_roi_tracking() && params->has_capability(CalibParams::CAP_ROI);
+            const bool prefilter = params->get_prefilter();
+            std::atomic<size_t> num_prefiltered{0};
+
+            if (params->get_roi_tracking() && !roi_tracking) {
+                spdlog::warn("The {} detector does not support search regions, ROI tracking disabled",
+                             params->getTargetType());
+            }
+
+            // Batches are the images of all cameras at one timestamp, tracking and the pre-filter work per image
+            const bool batch = params->has_capability(CalibParams::CAP_BATCH) && !roi_tracking && !prefilter;
+
+            // Backends that are not thread safe still run in the parallel loop, one call at a time
+            std::mutex detector_mutex;
+            const bool serialize = !params->has_capability(CalibParams::CAP_THREAD_SAFE);
+            auto detect = [&](auto &&call) {
+                if (serialize) {
+                    std::lock_guard<std::mutex> lock(detector_mutex);
+                    call();
+                } else {
+                    call();
+                }
+            };
+
+            /*
+             * The loop runs over (frame, camera), so that bags with few timestamps, e.g. snapshot recordings of a
+             * six camera rig, still occupy every core. Chunks are split along the dimension with the most grains
+             * left, each chunk is a run of consecutive frames of one or more cameras.
+             *
+             * Frames of a chunk are processed in order, so with ROI tracking a larger frame grain size means fewer
+             * frames that have to start from a full frame search. Likewise for frame quality, every chunk has to
+             * decode one extra frame as motion reference. Batches need all cameras of a timestamp in one chunk.
+             * */
+            const size_t frame_grain_size = (roi_tracking || this->frame_quality) ? 16 : 1;
+            const size_t cam_grain_size = batch ? std::max<size_t>(num_cams, 1) : 1;
 
             tbb::parallel_for(
-                    tbb::blocked_range<size_t>(0, this->dataset->get_image_timestamps().size()),
-                    [&](const tbb::blocked_range<size_t> &r) {
-                        for (size_t j = r.begin(); j != r.end(); ++j) {
+                    tbb::blocked_range2d<size_t>(0, this->dataset->get_image_timestamps().size(), frame_grain_size,
+                                                 0, num_cams, cam_grain_size),
+                    [&](const tbb::blocked_range2d<size_t> &r) {
+                        const size_t cam_begin = r.cols().begin();
+                        const size_t cam_end = r.cols().end();
+
+                        // Search region and number of corners of the previous frame in this chunk, per camera
+                        std::vector<cv::Rect> rois(num_cams);
+                        std::vector<size_t> prev_num_corners(num_cams, 0);
+
+                        std::vector<cv::Mat> prev_small;
+                        if (this->frame_quality) {
+                            prev_small = this->motionReference(r.rows().begin(), cam_begin, cam_end);
+                        }
+
+                        std::vector<ManagedImage<uint16_t>::Ptr> imgs;
+                        std::vector<CalibCornerData> batch_good, batch_bad;
+
+                        for (size_t j = r.rows().begin(); j != r.rows().end(); ++j) {
                             int64_t timestamp_ns = this->dataset->get_image_timestamps()[j];
-                            const std::vector<ImageData> &img_vec = this->dataset->get_image_data(timestamp_ns);
+                            const std::vector<ImageData> &img_vec =
+                                    this->dataset->get_image_data(timestamp_ns, cam_begin, cam_end);
+
+                            if (batch) {
+                                imgs.clear();
+                                for (const auto &img_data: img_vec) {
+                                    imgs.push_back(img_data.img);
+                                }
+                                detect([&]() { params->process_batch(imgs, batch_good, batch_bad); });
+                            }
+
+                            for (size_t i = cam_begin; i != cam_end; i++) {
+                                if (this->frame_quality) {
+                                    this->updateFrameQuality(TimeCamId(timestamp_ns, i), img_vec[i].img,
+                                                             prev_small[i]);
+                                }
 
-                            for (size_t i = 0; i < img_vec.size(); i++) {
                                 if (img_vec[i].img.get()) {
                                     CalibCornerData ccd_good;
                                     CalibCornerData ccd_bad;
 
-                                    params->process(*img_vec[i].img, ccd_good, ccd_bad);
+                                    const bool tracked = roi_tracking && !rois[i].empty();
+
+                                    if (batch) {
+                                        ccd_good = std::move(batch_good[i]);
+                                        ccd_bad = std::move(batch_bad[i]);
+                                    } else if (prefilter && !tracked && !params->board_likely(*img_vec[i].img)) {
+                                        // A tracked board was in the previous frame, no need to check for its presence
+                                        ccd_bad.prefiltered = true;
+                                        num_prefiltered++;
+                                    } else if (tracked) {
+                                        detect([&]() {
+                                            params->process_roi(*img_vec[i].img, rois[i], ccd_good, ccd_bad);
+                                        });
+
+                                        // Lost (part of) the board, it may have moved out of the search region
+                                        if (ccd_good.corners.size() < prev_num_corners[i]) {
+                                            ccd_good = CalibCornerData();
+                                            ccd_bad = CalibCornerData();
+                                            detect([&]() { params->process(*img_vec[i].img, ccd_good, ccd_bad); });
+                                        }
+                                    } else {
+                                        detect([&]() { params->process(*img_vec[i].img, ccd_good, ccd_bad); });
+                                    }
+
+                                    if (roi_tracking) {
+                                        const cv::Size img_size(img_vec[i].img->w, img_vec[i].img->h);
+                                        rois[i] = params->tracking_roi(ccd_good, img_size);
+                                        prev_num_corners[i] = ccd_good.corners.size();
+                                    }
+
                                     spdlog::debug("image ({},{})  detected {} corners ({} rejected)",
                                                   timestamp_ns, i, ccd_good.corners.size(),
                                                   ccd_bad.corners.size());
 
-                                    TimeCamId tcid(timestamp_ns, i);
-
                                     ccd_good.seq = j;
                                     ccd_bad.seq = j;
 
-                                    this->dataset->calib_corners.emplace(tcid, ccd_good);
-                                    this->dataset->calib_corners_rejected.emplace(tcid, ccd_bad);
+                                    this->dataset->calib_corners.set(j, i, CompactCornerData(ccd_good));
+                                    this->dataset->calib_corners_rejected.set(j, i, CompactCornerData(ccd_bad));
                                 }
                             }
                         }
                     });
 
+            if (prefilter) {
+                spdlog::info("Pre-filter skipped {} images without a plausible board", num_prefiltered.load());
+            }
             spdlog::debug("Successfully detected corners");
-            this->saveCache();
+            if (this->save_cache) {
+                this->saveCache(*params);
+            }
         }
     };
 }// namespace basalt
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "calibration/compact_corners.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace basalt {
+    CompactCornerData::CompactCornerData(const CalibCornerData &ccd)
+        : seq(ccd.seq), prefiltered(ccd.prefiltered), num_corners(static_cast<uint32_t>(ccd.corners.size())) {
+        std::shared_ptr<uint8_t> buffer(new uint8_t[BYTES_PER_CORNER * this->num_corners],
+                                        std::default_delete<uint8_t[]>());
+
+        float *x = reinterpret_cast<float *>(buffer.get());
+        float *y = x + this->num_corners;
+        uint16_t *ids = reinterpret_cast<uint16_t *>(y + this->num_corners);
+        uint8_t *radii = reinterpret_cast<uint8_t *>(ids + this->num_corners);
+
+        for (size_t i = 0; i < this->num_corners; i++) {
+            x[i] = static_cast<float>(ccd.corners[i][0]);
+            y[i] = static_cast<float>(ccd.corners[i][1]);
+
+            const int id = i < ccd.corner_ids.size() ? ccd.corner_ids[i] : static_cast<int>(i);
+            if (id < 0 || id > std::numeric_limits<uint16_t>::max()) {
+                throw std::out_of_range("corner id " + std::to_string(id) + " does not fit into 16 bits");
+            }
+            ids[i] = static_cast<uint16_t>(id);
+
+            const double r = i < ccd.radii.size() ? ccd.radii[i] : 0.0;
+            radii[i] = static_cast<uint8_t>(std::lround(std::clamp(r, 0.0, MAX_RADIUS) / RADIUS_STEP));
+        }
+        this->arrays = std::move(buffer);
+    }
+
+    CompactCornerData CompactCornerData::view(std::shared_ptr<const uint8_t> arrays, uint32_t num_corners, size_t seq,
+                                              bool prefiltered) {
+        CompactCornerData c;
+        c.arrays = std::move(arrays);
+        c.num_corners = num_corners;
+        c.seq = seq;
+        c.prefiltered = prefiltered;
+        return c;
+    }
+
+    CalibCornerData CompactCornerData::to_calib_corner_data() const {
+        CalibCornerData ccd;
+        ccd.seq = this->seq;
+        ccd.prefiltered = this->prefiltered;
+
+        ccd.corners.reserve(this->num_corners);
+        ccd.corner_ids.reserve(this->num_corners);
+        ccd.radii.reserve(this->num_corners);
+        for (size_t i = 0; i < this->num_corners; i++) {
+            ccd.corners.push_back(this->corner(i));
+            ccd.corner_ids.push_back(this->id(i));
+            ccd.radii.push_back(this->radius(i));
+        }
+        return ccd;
+    }
+}// namespace basalt
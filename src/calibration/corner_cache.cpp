@@ -0,0 +1,278 @@
+#include "calibration/corner_cache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace basalt {
+    namespace {
+        constexpr uint64_t ALIGNMENT = 8;
+
+        inline uint64_t align(uint64_t n) { return (n + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+        // The file is read in place, so it only works on hosts with the byte order it is written in
+        inline bool is_little_endian() {
+            const uint16_t one = 1;
+            uint8_t first;
+            std::memcpy(&first, &one, 1);
+            return first == 1;
+        }
+
+        // Whether [offset, offset + bytes) lies within a file of size bytes, without overflowing
+        inline bool in_file(uint64_t offset, uint64_t bytes, uint64_t size) {
+            return offset <= size && bytes <= size - offset;
+        }
+
+        // Sequential writer that pads to the offsets of the layout
+        class Writer {
+        public:
+            explicit Writer(const fs::path &path) : os(path, std::ios::binary | std::ios::trunc) {}
+
+            inline void write(const void *data, uint64_t bytes) {
+                this->os.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes));
+                this->pos += bytes;
+            }
+
+            inline void pad_to(uint64_t offset) {
+                static const char zeros[ALIGNMENT] = {};
+                while (this->pos < offset) {
+                    this->write(zeros, std::min(offset - this->pos, ALIGNMENT));
+                }
+            }
+
+            std::ofstream os;
+            uint64_t pos = 0;
+        };
+    }// namespace
+
+    uint64_t dataset_fingerprint(const std::vector<int64_t> &timestamps, size_t num_cams,
+                                 const std::string &target_key) {
+        uint64_t hash = 0xcbf29ce484222325;
+        auto add_byte = [&hash](uint8_t byte) { hash = (hash ^ byte) * 0x100000001b3; };
+        auto add = [&add_byte](uint64_t value) {
+            for (int i = 0; i < 8; i++) {
+                add_byte((value >> (8 * i)) & 0xff);
+            }
+        };
+
+        add(num_cams);
+        add(timestamps.size());
+        for (int64_t t: timestamps) {
+            add(static_cast<uint64_t>(t));
+        }
+        add(target_key.size());
+        for (char c: target_key) {
+            add_byte(static_cast<uint8_t>(c));
+        }
+        return hash;
+    }
+
+    void save_corner_cache(const fs::path &path, uint64_t fingerprint, const CalibCornerTable &corners,
+                           const CalibCornerTable &rejected) {
+        if (!is_little_endian()) {
+            throw std::runtime_error("corner caches can only be written on little endian hosts");
+        }
+
+        const CalibCornerTable *tables[CornerCacheHeader::NUM_TABLES] = {&corners, &rejected};
+
+        CornerCacheHeader header{};
+        std::memcpy(header.magic, CornerCacheHeader::MAGIC, sizeof(header.magic));
+        header.version = CornerCacheHeader::VERSION;
+        header.num_tables = CornerCacheHeader::NUM_TABLES;
+        header.fingerprint = fingerprint;
+
+        // Lay out the frame tables behind the header and the corners of all tables in the arena
+        std::vector<CornerCacheSlot> slots[CornerCacheHeader::NUM_TABLES];
+        uint64_t pos = align(sizeof(CornerCacheHeader));
+        uint64_t arena_size = 0;
+        for (size_t t = 0; t < CornerCacheHeader::NUM_TABLES; t++) {
+            const CalibCornerTable &table = *tables[t];
+            CornerCacheTableHeader &th = header.tables[t];
+            th.num_frames = table.get_num_frames();
+            th.num_cams = table.get_num_cams();
+            th.timestamps_offset = pos;
+            pos = align(pos + th.num_frames * sizeof(int64_t));
+            th.slots_offset = pos;
+            pos = align(pos + th.num_frames * th.num_cams * sizeof(CornerCacheSlot));
+
+            slots[t].resize(th.num_frames * th.num_cams);
+            for (size_t frame = 0; frame < th.num_frames; frame++) {
+                for (size_t cam = 0; cam < th.num_cams; cam++) {
+                    const CompactCornerData *ccd = table.get(frame, cam);
+                    CornerCacheSlot &slot = slots[t][frame * th.num_cams + cam];
+                    slot = CornerCacheSlot{};
+                    if (ccd) {
+                        slot.offset = arena_size;
+                        slot.seq = ccd->seq;
+                        slot.num_corners = static_cast<uint32_t>(ccd->size());
+                        slot.flags = CornerCacheSlot::FILLED | (ccd->prefiltered ? CornerCacheSlot::PREFILTERED : 0);
+                        arena_size = align(arena_size + ccd->memory_bytes());
+                    }
+                }
+            }
+        }
+        header.arena_offset = pos;
+        header.arena_size = arena_size;
+        header.file_size = pos + arena_size;
+
+        fs::path tmp_path = path;
+        tmp_path += ".tmp";
+        {
+            Writer writer(tmp_path);
+            writer.write(&header, sizeof(header));
+            for (size_t t = 0; t < CornerCacheHeader::NUM_TABLES; t++) {
+                writer.pad_to(header.tables[t].timestamps_offset);
+                writer.write(tables[t]->get_timestamps().data(), header.tables[t].num_frames * sizeof(int64_t));
+                writer.pad_to(header.tables[t].slots_offset);
+                writer.write(slots[t].data(), slots[t].size() * sizeof(CornerCacheSlot));
+            }
+            for (size_t t = 0; t < CornerCacheHeader::NUM_TABLES; t++) {
+                for (size_t i = 0; i < slots[t].size(); i++) {
+                    if (slots[t][i].flags & CornerCacheSlot::FILLED) {
+                        const CompactCornerData *ccd = tables[t]->get(i / header.tables[t].num_cams,
+                                                                      i % header.tables[t].num_cams);
+                        writer.pad_to(header.arena_offset + slots[t][i].offset);
+                        writer.write(ccd->data(), ccd->memory_bytes());
+                    }
+                }
+            }
+            writer.pad_to(header.file_size);
+
+            writer.os.close();
+            if (!writer.os) {
+                fs::remove(tmp_path);
+                throw std::runtime_error("cannot write corner cache " + tmp_path.string());
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tmp_path, path, ec);
+        if (ec) {
+            fs::remove(tmp_path);
+            throw std::runtime_error("cannot write corner cache " + path.string() + ": " + ec.message());
+        }
+    }
+
+    CornerCacheFile::CornerCacheFile(std::shared_ptr<const uint8_t> mapping)
+        : mapping(std::move(mapping)), header(reinterpret_cast<const CornerCacheHeader *>(this->mapping.get())) {}
+
+    CornerCacheFile CornerCacheFile::open(const fs::path &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open corner cache " + path.string() + ": " + std::strerror(errno));
+        }
+
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(CornerCacheHeader)) {
+            ::close(fd);
+            throw std::runtime_error("invalid corner cache " + path.string() + ": too small");
+        }
+        const uint64_t size = static_cast<uint64_t>(st.st_size);
+
+        void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("cannot map corner cache " + path.string() + ": " + std::strerror(errno));
+        }
+        std::shared_ptr<const uint8_t> mapping(static_cast<const uint8_t *>(addr), [size](const uint8_t *p) {
+            ::munmap(const_cast<uint8_t *>(p), size);
+        });
+        CornerCacheFile file(std::move(mapping));
+
+        auto check = [&path](bool ok, const char *what) {
+            if (!ok) {
+                throw std::runtime_error("invalid corner cache " + path.string() + ": " + what);
+            }
+        };
+
+        // Everything read later is checked here once, so that lookups can trust the file
+        const CornerCacheHeader &header = *file.header;
+        check(std::memcmp(header.magic, CornerCacheHeader::MAGIC, sizeof(header.magic)) == 0, "unknown format");
+        check(header.version == CornerCacheHeader::VERSION, "unsupported version");
+        check(is_little_endian(), "host is not little endian");
+        check(header.num_tables == CornerCacheHeader::NUM_TABLES, "wrong number of tables");
+        check(header.file_size == size, "truncated");
+        check(header.arena_offset % ALIGNMENT == 0 && in_file(header.arena_offset, header.arena_size, size),
+              "arena out of bounds");
+
+        for (size_t t = 0; t < CornerCacheHeader::NUM_TABLES; t++) {
+            const CornerCacheTableHeader &th = header.tables[t];
+            check(th.timestamps_offset % ALIGNMENT == 0 && th.num_frames <= size / sizeof(int64_t) &&
+                          in_file(th.timestamps_offset, th.num_frames * sizeof(int64_t), size),
+                  "timestamps out of bounds");
+            check(th.num_frames == 0 || th.num_cams <= size / sizeof(CornerCacheSlot) / th.num_frames,
+                  "too many slots");
+            check(th.slots_offset % ALIGNMENT == 0 &&
+                          in_file(th.slots_offset, th.num_frames * th.num_cams * sizeof(CornerCacheSlot), size),
+                  "slots out of bounds");
+
+            const int64_t *timestamps = file.timestamps(t);
+            check(std::is_sorted(timestamps, timestamps + th.num_frames), "timestamps not ascending");
+
+            const CornerCacheSlot *slots = file.slots(t);
+            for (size_t i = 0; i < th.num_frames * th.num_cams; i++) {
+                if (slots[i].flags & CornerCacheSlot::FILLED) {
+                    check(slots[i].offset % alignof(float) == 0 &&
+                                  in_file(slots[i].offset,
+                                          uint64_t(slots[i].num_corners) * CompactCornerData::BYTES_PER_CORNER,
+                                          header.arena_size),
+                          "corners out of bounds");
+                }
+            }
+        }
+        return file;
+    }
+
+    const int64_t *CornerCacheFile::timestamps(size_t table) const {
+        return reinterpret_cast<const int64_t *>(this->mapping.get() + this->header->tables[table].timestamps_offset);
+    }
+
+    const CornerCacheSlot *CornerCacheFile::slots(size_t table) const {
+        return reinterpret_cast<const CornerCacheSlot *>(this->mapping.get() +
+                                                         this->header->tables[table].slots_offset);
+    }
+
+    size_t CornerCacheFile::frame_index(size_t table, int64_t timestamp) const {
+        const int64_t *begin = this->timestamps(table);
+        const int64_t *end = begin + this->num_frames(table);
+        const int64_t *it = std::lower_bound(begin, end, timestamp);
+        if (it == end || *it != timestamp) {
+            return CalibCornerTable::npos;
+        }
+        return static_cast<size_t>(it - begin);
+    }
+
+    std::optional<CompactCornerData> CornerCacheFile::get(size_t table, size_t frame, size_t cam) const {
+        const CornerCacheSlot &slot = this->slots(table)[frame * this->num_cams(table) + cam];
+        if (!(slot.flags & CornerCacheSlot::FILLED)) {
+            return std::nullopt;
+        }
+
+        // Shares ownership of the mapping, pointing at the corners
+        std::shared_ptr<const uint8_t> arrays(this->mapping,
+                                              this->mapping.get() + this->header->arena_offset + slot.offset);
+        return CompactCornerData::view(std::move(arrays), slot.num_corners, slot.seq,
+                                       slot.flags & CornerCacheSlot::PREFILTERED);
+    }
+
+    void CornerCacheFile::load(size_t table, CalibCornerTable &out) const {
+        const int64_t *timestamps = this->timestamps(table);
+        out.reset(std::vector<int64_t>(timestamps, timestamps + this->num_frames(table)), this->num_cams(table));
+
+        for (size_t frame = 0; frame < this->num_frames(table); frame++) {
+            for (size_t cam = 0; cam < this->num_cams(table); cam++) {
+                if (auto ccd = this->get(table, frame, cam)) {
+                    out.set(frame, cam, std::move(*ccd));
+                }
+            }
+        }
+    }
+}// namespace basalt
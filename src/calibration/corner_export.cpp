@@ -0,0 +1,234 @@
+#include "calibration/corner_export.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace basalt {
+    namespace {
+        // Frames formatted by one task
+        constexpr size_t FRAMES_PER_CHUNK = 32;
+
+        // Bytes collected before they are written
+        constexpr size_t BUFFER_SIZE = 1 << 20;
+
+        // Appends numbers in their shortest round trip representation
+        template<class T>
+        inline void append_number(std::string &out, T value) {
+            char buf[32];
+            const auto res = std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, res.ptr);
+        }
+
+        // Buffered writes to a file descriptor
+        class FileWriter {
+        public:
+            explicit FileWriter(const fs::path &path) : path(path) {
+                this->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (this->fd < 0) {
+                    this->fail();
+                }
+                this->buffer.reserve(BUFFER_SIZE);
+            }
+
+            ~FileWriter() {
+                if (this->fd >= 0) {
+                    ::close(this->fd);
+                }
+            }
+
+            inline void write(std::string_view s) {
+                if (this->buffer.size() + s.size() > BUFFER_SIZE) {
+                    this->flush();
+                }
+                if (s.size() >= BUFFER_SIZE) {
+                    this->write_fd(s);
+                } else {
+                    this->buffer.append(s);
+                }
+            }
+
+            void close() {
+                this->flush();
+                const int fd = this->fd;
+                this->fd = -1;
+                if (::close(fd) != 0) {
+                    this->fail();
+                }
+            }
+
+        private:
+            void flush() {
+                this->write_fd(this->buffer);
+                this->buffer.clear();
+            }
+
+            void write_fd(std::string_view s) {
+                while (!s.empty()) {
+                    const ssize_t n = ::write(this->fd, s.data(), s.size());
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        this->fail();
+                    }
+                    s.remove_prefix(static_cast<size_t>(n));
+                }
+            }
+
+            [[noreturn]] void fail() const {
+                throw std::runtime_error("cannot write " + this->path.string() + ": " + std::strerror(errno));
+            }
+
+            fs::path path;
+            int fd = -1;
+            std::string buffer;
+        };
+
+        /*
+         * Calls format(out, timestamp, cam, corners) for every filled slot of table, on all threads, and sink(chunk)
+         * with the formatted chunks in table order on the calling thread. The next window of chunks is formatted
+         * while the current one is handed to sink, which bounds the memory to two windows.
+         * */
+        template<class Format, class Sink>
+        void stream_table(const CalibCornerTable &table, const Format &format, const Sink &sink) {
+            const size_t num_frames = table.get_num_frames();
+            const size_t num_chunks = (num_frames + FRAMES_PER_CHUNK - 1) / FRAMES_PER_CHUNK;
+            const size_t window = 4 * static_cast<size_t>(tbb::this_task_arena::max_concurrency());
+
+            auto format_window = [&](size_t first_chunk, std::vector<std::string> &chunks) {
+                chunks.assign(std::min(window, num_chunks - first_chunk), std::string());
+                tbb::parallel_for(size_t(0), chunks.size(), [&](size_t i) {
+                    const size_t begin = (first_chunk + i) * FRAMES_PER_CHUNK;
+                    const size_t end = std::min(begin + FRAMES_PER_CHUNK, num_frames);
+                    for (size_t frame = begin; frame < end; frame++) {
+                        for (size_t cam = 0; cam < table.get_num_cams(); cam++) {
+                            if (const CompactCornerData *ccd = table.get(frame, cam)) {
+                                format(chunks[i], table.get_timestamps()[frame], cam, *ccd);
+                            }
+                        }
+                    }
+                });
+            };
+
+            std::vector<std::string> current, next;
+            if (num_chunks > 0) {
+                format_window(0, current);
+            }
+            for (size_t first_chunk = 0; first_chunk < num_chunks; first_chunk += window) {
+                tbb::task_group tg;
+                if (first_chunk + window < num_chunks) {
+                    tg.run([&, first_chunk]() { format_window(first_chunk + window, next); });
+                }
+                try {
+                    for (const std::string &chunk: current) {
+                        sink(chunk);
+                    }
+                } catch (...) {
+                    tg.wait();
+                    throw;
+                }
+                tg.wait();
+                std::swap(current, next);
+            }
+        }
+
+        // One image, preceded by a comma. The first image of an array drops it.
+        void format_json(std::string &out, int64_t timestamp, size_t cam, const CompactCornerData &ccd) {
+            out += ",\n    {\"timestamp_ns\":";
+            append_number(out, timestamp);
+            out += ",\"cam_id\":";
+            append_number(out, cam);
+            out += ",\"seq\":";
+            append_number(out, ccd.seq);
+            out += ccd.prefiltered ? ",\"prefiltered\":true" : ",\"prefiltered\":false";
+
+            out += ",\"corner_ids\":[";
+            for (size_t i = 0; i < ccd.size(); i++) {
+                if (i > 0) {
+                    out += ',';
+                }
+                append_number(out, ccd.ids()[i]);
+            }
+            out += "],\"corners\":[";
+            for (size_t i = 0; i < ccd.size(); i++) {
+                out += i > 0 ? ",[" : "[";
+                append_number(out, ccd.xs()[i]);
+                out += ',';
+                append_number(out, ccd.ys()[i]);
+                out += ']';
+            }
+            out += "],\"radii\":[";
+            for (size_t i = 0; i < ccd.size(); i++) {
+                if (i > 0) {
+                    out += ',';
+                }
+                append_number(out, static_cast<float>(ccd.radius(i)));
+            }
+            out += "]}";
+        }
+
+        void write_json_array(FileWriter &writer, const char *name, const CalibCornerTable &table) {
+            writer.write("  \"");
+            writer.write(name);
+            writer.write("\": [");
+
+            bool first = true;
+            stream_table(table, format_json, [&](std::string_view chunk) {
+                if (first && !chunk.empty()) {
+                    chunk.remove_prefix(1);
+                    first = false;
+                }
+                writer.write(chunk);
+            });
+            writer.write(first ? "]" : "\n  ]");
+        }
+
+        void format_csv(std::string &out, int64_t timestamp, size_t cam, const CompactCornerData &ccd) {
+            for (size_t i = 0; i < ccd.size(); i++) {
+                append_number(out, timestamp);
+                out += ',';
+                append_number(out, cam);
+                out += ',';
+                append_number(out, ccd.ids()[i]);
+                out += ',';
+                append_number(out, ccd.xs()[i]);
+                out += ',';
+                append_number(out, ccd.ys()[i]);
+                out += ',';
+                append_number(out, static_cast<float>(ccd.radius(i)));
+                out += '\n';
+            }
+        }
+    }// namespace
+
+    void export_corners_json(const fs::path &path, const CalibCornerTable &corners,
+                             const CalibCornerTable &rejected) {
+        FileWriter writer(path);
+        writer.write("{\n");
+        write_json_array(writer, "corners", corners);
+        writer.write(",\n");
+        write_json_array(writer, "corners_rejected", rejected);
+        writer.write("\n}\n");
+        writer.close();
+    }
+
+    void export_corners_kalibr_csv(const fs::path &path, const CalibCornerTable &corners) {
+        FileWriter writer(path);
+        writer.write("#timestamp [ns],cam_id,corner_id,x [px],y [px],radius [px]\n");
+        stream_table(corners, format_csv, [&](std::string_view chunk) { writer.write(chunk); });
+        writer.close();
+    }
+}// namespace basalt
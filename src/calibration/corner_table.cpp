@@ -0,0 +1,177 @@
+#include "calibration/corner_table.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace basalt {
+    CalibCornerTable::CalibCornerTable(const CalibCornerTable &other)
+        : timestamps(other.timestamps), num_cams(other.num_cams), slots(other.slots), filled(other.filled),
+          num_filled(other.size()) {}
+
+    CalibCornerTable::CalibCornerTable(CalibCornerTable &&other) noexcept
+        : timestamps(std::move(other.timestamps)), num_cams(other.num_cams), slots(std::move(other.slots)),
+          filled(std::move(other.filled)), num_filled(other.size()) {
+        other.clear();
+    }
+
+    CalibCornerTable &CalibCornerTable::operator=(const CalibCornerTable &other) {
+        if (this != &other) {
+            this->timestamps = other.timestamps;
+            this->num_cams = other.num_cams;
+            this->slots = other.slots;
+            this->filled = other.filled;
+            this->num_filled = other.size();
+        }
+        return *this;
+    }
+
+    CalibCornerTable &CalibCornerTable::operator=(CalibCornerTable &&other) noexcept {
+        if (this != &other) {
+            this->timestamps = std::move(other.timestamps);
+            this->num_cams = other.num_cams;
+            this->slots = std::move(other.slots);
+            this->filled = std::move(other.filled);
+            this->num_filled = other.size();
+            other.clear();
+        }
+        return *this;
+    }
+
+    void CalibCornerTable::reset(const std::vector<int64_t> &timestamps, size_t num_cams) {
+        assert(std::is_sorted(timestamps.begin(), timestamps.end()));
+
+        this->timestamps = timestamps;
+        this->num_cams = num_cams;
+
+        this->slots.resize(timestamps.size() * num_cams);
+        for (size_t f = 0; f < timestamps.size(); f++) {
+            for (size_t cam = 0; cam < num_cams; cam++) {
+                value_type &slot = this->slots[f * num_cams + cam];
+                slot.first = TimeCamId(timestamps[f], cam);
+                slot.second = CompactCornerData();
+            }
+        }
+        this->filled.assign(this->slots.size(), 0);
+        this->num_filled = 0;
+    }
+
+    void CalibCornerTable::set(size_t frame, size_t cam, CompactCornerData data) {
+        assert(frame < this->timestamps.size() && cam < this->num_cams);
+
+        const size_t idx = frame * this->num_cams + cam;
+        this->slots[idx].second = std::move(data);
+        if (!this->filled[idx]) {
+            this->filled[idx] = 1;
+            this->num_filled.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    size_t CalibCornerTable::frame_index(int64_t timestamp) const {
+        auto it = std::lower_bound(this->timestamps.begin(), this->timestamps.end(), timestamp);
+        if (it == this->timestamps.end() || *it != timestamp) {
+            return npos;
+        }
+        return static_cast<size_t>(it - this->timestamps.begin());
+    }
+
+    size_t CalibCornerTable::slot_index(const TimeCamId &tcid) const {
+        const size_t frame = this->frame_index(tcid.frame_id);
+        if (frame == npos || tcid.cam_id >= this->num_cams) {
+            return npos;
+        }
+        return frame * this->num_cams + tcid.cam_id;
+    }
+
+    size_t CalibCornerTable::next_filled(size_t idx) const {
+        while (idx < this->filled.size() && !this->filled[idx]) {
+            idx++;
+        }
+        return std::min(idx, this->slots.size());
+    }
+
+    void CalibCornerTable::grow(const TimeCamId &tcid) {
+        std::vector<int64_t> new_timestamps = this->timestamps;
+        if (this->frame_index(tcid.frame_id) == npos) {
+            new_timestamps.insert(std::upper_bound(new_timestamps.begin(), new_timestamps.end(), tcid.frame_id),
+                                  tcid.frame_id);
+        }
+        const size_t new_num_cams = std::max(this->num_cams, tcid.cam_id + 1);
+
+        // Appending a frame, the common case when entries come in order, keeps the layout of the existing slots
+        if (new_num_cams == this->num_cams && new_timestamps.back() == tcid.frame_id &&
+            new_timestamps.size() == this->timestamps.size() + 1) {
+            this->timestamps.push_back(tcid.frame_id);
+            for (size_t cam = 0; cam < this->num_cams; cam++) {
+                this->slots.emplace_back(TimeCamId(tcid.frame_id, cam), CompactCornerData());
+            }
+            this->filled.resize(this->slots.size(), 0);
+            return;
+        }
+
+        CalibCornerTable old = std::move(*this);
+        this->reset(new_timestamps, new_num_cams);
+        for (size_t idx = 0; idx < old.slots.size(); idx++) {
+            if (old.filled[idx]) {
+                const TimeCamId &key = old.slots[idx].first;
+                this->set(this->frame_index(key.frame_id), key.cam_id, std::move(old.slots[idx].second));
+            }
+        }
+    }
+
+    std::pair<CalibCornerTable::const_iterator, bool> CalibCornerTable::emplace(const TimeCamId &tcid,
+                                                                                CompactCornerData data) {
+        size_t idx = this->slot_index(tcid);
+        if (idx == npos) {
+            this->grow(tcid);
+            idx = this->slot_index(tcid);
+        }
+
+        if (this->filled[idx]) {
+            return {const_iterator(this, idx), false};
+        }
+        this->set(idx / this->num_cams, idx % this->num_cams, std::move(data));
+        return {const_iterator(this, idx), true};
+    }
+
+    CalibCornerTable::const_iterator CalibCornerTable::find(const TimeCamId &tcid) const {
+        const size_t idx = this->slot_index(tcid);
+        if (idx == npos || !this->filled[idx]) {
+            return this->end();
+        }
+        return const_iterator(this, idx);
+    }
+
+    const CompactCornerData &CalibCornerTable::at(const TimeCamId &tcid) const {
+        const size_t idx = this->slot_index(tcid);
+        if (idx == npos || !this->filled[idx]) {
+            throw std::out_of_range("no corners for this timestamp and camera");
+        }
+        return this->slots[idx].second;
+    }
+
+    void CalibCornerTable::clear() {
+        this->timestamps.clear();
+        this->num_cams = 0;
+        this->slots.clear();
+        this->filled.clear();
+        this->num_filled = 0;
+    }
+
+    void CalibCornerTable::assign(std::vector<value_type> &&items) {
+        std::vector<int64_t> new_timestamps;
+        size_t new_num_cams = 0;
+        new_timestamps.reserve(items.size());
+        for (const auto &item: items) {
+            new_timestamps.push_back(item.first.frame_id);
+            new_num_cams = std::max(new_num_cams, item.first.cam_id + 1);
+        }
+        std::sort(new_timestamps.begin(), new_timestamps.end());
+        new_timestamps.erase(std::unique(new_timestamps.begin(), new_timestamps.end()), new_timestamps.end());
+
+        this->reset(new_timestamps, new_num_cams);
+        for (auto &item: items) {
+            this->set(this->frame_index(item.first.frame_id), item.first.cam_id, std::move(item.second));
+        }
+    }
+}// namespace basalt
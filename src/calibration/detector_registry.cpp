@@ -0,0 +1,72 @@
+#include "calibration/detector_registry.hpp"
+
+#include <stdexcept>
+
+namespace basalt {
+    DetectorRegistry &DetectorRegistry::get_instance() {
+        static DetectorRegistry instance;
+        return instance;
+    }
+
+    DetectorRegistry::DetectorRegistry() {
+        this->add({"aprilgrid", "aprilgrid", "ETH AprilTag 2 detector", [](const DetectorConfig &config) {
+                       if (!config.april_grid) {
+                           throw std::invalid_argument("aprilgrid target needs an AprilGrid configuration");
+                       }
+                       if (config.quad_decimate == 0 && !config.camera_prior) {
+                           throw std::invalid_argument("automatic quad decimation needs a camera prior");
+                       }
+
+                       auto params = std::make_shared<AprilGridParams>(config.april_grid);
+                       params->set_quad_decimate(config.quad_decimate > 0
+                                                         ? config.quad_decimate
+                                                         : AprilGridParams::auto_quad_decimate(
+                                                                   *config.april_grid, *config.camera_prior,
+                                                                   config.max_target_distance));
+                       return std::static_pointer_cast<CalibParams>(params);
+                   }});
+
+        this->add({"checkerboard_opencv", "checkerboard",
+                   "OpenCV findChessboardCornersSB, with a pyramid level findChessboardCorners and cornerSubPix",
+                   [](const DetectorConfig &config) {
+                       if (config.board_width < 2 || config.board_height < 2) {
+                           throw std::invalid_argument("checkerboard target needs the board size");
+                       }
+                       return std::static_pointer_cast<CalibParams>(std::make_shared<OpenCVCheckerboardParams>(
+                               config.board_width, config.board_height, config.adaptive_thresh,
+                               config.normalize_image, config.filter_quads, config.fast_check,
+                               config.enable_subpix_refine, config.pyramid_level));
+                   }});
+    }
+
+    bool DetectorRegistry::add(const Backend &backend) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->backends.emplace(backend.name, backend).second;
+    }
+
+    std::shared_ptr<CalibParams> DetectorRegistry::create(const std::string &name,
+                                                          const DetectorConfig &config) const {
+        Factory factory;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            auto it = this->backends.find(name);
+            if (it == this->backends.end()) {
+                throw std::invalid_argument("unknown detector " + name);
+            }
+            factory = it->second.factory;
+        }
+        return factory(config);
+    }
+
+    std::vector<DetectorRegistry::Backend> DetectorRegistry::list(const std::string &target) const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        std::vector<Backend> res;
+        for (const auto &kv: this->backends) {
+            if (target.empty() || kv.second.target == target) {
+                res.push_back(kv.second);
+            }
+        }
+        return res;
+    }
+}// namespace basalt
@@ -0,0 +1,74 @@
+#include "calibration/frame_quality.hpp"
+
+namespace basalt {
+    FrameQuality FrameQualityEstimator::compute(const basalt::Image<uint16_t> &img, cv::Mat &small,
+                                                const cv::Mat &prev_small) const {
+        FrameQuality q;
+
+        const cv::Mat image16(static_cast<int>(img.h), static_cast<int>(img.w), CV_16U, img.ptr, img.pitch);
+
+        // Power of two downsampling, INTER_AREA then averages whole pixel blocks
+        int factor = 1;
+        while (image16.cols / factor > this->max_width) {
+            factor *= 2;
+        }
+
+        cv::Mat small16;
+        if (factor > 1) {
+            cv::resize(image16, small16, cv::Size(image16.cols / factor, image16.rows / factor), 0, 0,
+                       cv::INTER_AREA);
+        } else {
+            small16 = image16;
+        }
+        small16.convertTo(small, CV_8U, 1.0 / 256.0);
+
+        const double num_pixels = static_cast<double>(small.total());
+        if (num_pixels == 0) {
+            return q;
+        }
+
+        // Sharpness
+        cv::Mat laplacian;
+        cv::Laplacian(small, laplacian, CV_16S);
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(laplacian, mean, stddev);
+        q.sharpness = stddev[0] * stddev[0];
+
+        // Exposure
+        cv::Mat hist;
+        const int hist_size = 256;
+        const float range[] = {0, 256};
+        const float *ranges[] = {range};
+        cv::calcHist(&small, 1, nullptr, cv::Mat(), hist, 1, &hist_size, ranges);
+
+        double under = 0.0, over = 0.0;
+        for (int v = 0; v <= this->under_level; v++) {
+            under += hist.at<float>(v);
+        }
+        for (int v = this->over_level; v < hist_size; v++) {
+            over += hist.at<float>(v);
+        }
+        q.underexposed = under / num_pixels;
+        q.overexposed = over / num_pixels;
+
+        // Motion
+        if (!prev_small.empty() && prev_small.size() == small.size()) {
+            q.motion = cv::norm(small, prev_small, cv::NORM_L1) / num_pixels;
+        }
+
+        return q;
+    }
+
+    CalibCornerTable filter_corners_by_quality(const CalibCornerTable &corners, const FrameQualityMap &quality,
+                                               const FrameQualityThresholds &thresholds) {
+        CalibCornerTable res;
+        res.reset_like(corners);
+        for (const auto &kv: corners) {
+            auto it = quality.find(kv.first);
+            if (it == quality.end() || thresholds.pass(it->second)) {
+                res.set(res.frame_index(kv.first.frame_id), kv.first.cam_id, kv.second);
+            }
+        }
+        return res;
+    }
+}// namespace basalt
@@ -0,0 +1,181 @@
+#include "calibration/frame_selection.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace basalt {
+    namespace {
+        constexpr int NUM_SCALE_BINS = 4;
+        constexpr int NUM_ANGLE_BINS = 8;
+        constexpr int NUM_SHAPE_BINS = 3;
+        constexpr int NUM_POSE_BINS = NUM_SCALE_BINS * NUM_ANGLE_BINS * NUM_SHAPE_BINS;
+
+        struct Candidate {
+            TimeCamId tcid;
+            const CompactCornerData *ccd;
+            std::vector<int> cells;// unique coverage grid cells with at least one corner
+            int pose_bin;
+        };
+
+        int pose_bin(const CompactCornerData &ccd, const Eigen::Vector2d &res) {
+            const double n = static_cast<double>(ccd.size());
+
+            Eigen::Vector2d mean = Eigen::Vector2d::Zero();
+            for (size_t i = 0; i < ccd.size(); i++) {
+                mean += ccd.corner(i);
+            }
+            mean /= n;
+
+            Eigen::Matrix2d cov = Eigen::Matrix2d::Zero();
+            for (size_t i = 0; i < ccd.size(); i++) {
+                const Eigen::Vector2d d = ccd.corner(i) - mean;
+                cov += d * d.transpose();
+            }
+            cov /= n;
+
+            const Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> es(cov);
+            const Eigen::Vector2d ev = es.eigenvalues().cwiseMax(0.0);// ascending
+
+            // Apparent size, spread of the corners relative to the image diagonal
+            const double size = 2.0 * std::sqrt(ev[0] + ev[1]) / res.norm();
+            const int scale_bin = size < 0.1 ? 0 : size < 0.2 ? 1 : size < 0.35 ? 2 : 3;
+
+            // In-plane rotation, direction from the lowest to the highest corner id
+            const auto id_range = std::minmax_element(ccd.ids(), ccd.ids() + ccd.size());
+            const Eigen::Vector2d dir =
+                    ccd.corner(id_range.second - ccd.ids()) - ccd.corner(id_range.first - ccd.ids());
+            const double angle = std::atan2(dir[1], dir[0]);
+            const int angle_bin = std::min(NUM_ANGLE_BINS - 1,
+                                           static_cast<int>((angle + M_PI) / (2.0 * M_PI) * NUM_ANGLE_BINS));
+
+            // Foreshortening, a tilted board is squashed along one axis
+            const double shape = ev[1] > 0.0 ? std::sqrt(ev[0] / ev[1]) : 1.0;
+            const int shape_bin = shape < 0.5 ? 0 : shape < 0.8 ? 1 : 2;
+
+            return (scale_bin * NUM_ANGLE_BINS + angle_bin) * NUM_SHAPE_BINS + shape_bin;
+        }
+
+        void select_camera(std::vector<Candidate> &candidates, const Eigen::Vector2d &res,
+                           const FrameSelectionParams &params, CalibCornerTable &selected) {
+            const int num_cells = params.grid_cols * params.grid_rows;
+
+            for (auto &cand: candidates) {
+                for (size_t i = 0; i < cand.ccd->size(); i++) {
+                    const Eigen::Vector2d c = cand.ccd->corner(i);
+                    const int col = std::clamp(static_cast<int>(c[0] / res[0] * params.grid_cols), 0,
+                                               params.grid_cols - 1);
+                    const int row = std::clamp(static_cast<int>(c[1] / res[1] * params.grid_rows), 0,
+                                               params.grid_rows - 1);
+                    cand.cells.push_back(row * params.grid_cols + col);
+                }
+                std::sort(cand.cells.begin(), cand.cells.end());
+                cand.cells.erase(std::unique(cand.cells.begin(), cand.cells.end()), cand.cells.end());
+
+                cand.pose_bin = pose_bin(*cand.ccd, res);
+            }
+
+            std::vector<int> cell_count(num_cells, 0);
+            std::vector<int> pose_count(NUM_POSE_BINS, 0);
+
+            auto gain = [&](const Candidate &cand) {
+                double g = 0.0;
+                for (int cell: cand.cells) {
+                    g += cell_count[cell] < params.cell_capacity;
+                }
+                if (pose_count[cand.pose_bin] < params.pose_capacity) {
+                    g += params.pose_weight;
+                }
+                return g;
+            };
+
+            // Max-heap of possibly stale gains, ties go to the earlier frame
+            using Entry = std::pair<double, size_t>;
+            auto cmp = [](const Entry &a, const Entry &b) {
+                return a.first < b.first || (a.first == b.first && a.second > b.second);
+            };
+            std::priority_queue<Entry, std::vector<Entry>, decltype(cmp)> heap(cmp);
+            for (size_t i = 0; i < candidates.size(); i++) {
+                heap.emplace(gain(candidates[i]), i);
+            }
+
+            // Gains only shrink as frames get selected (submodularity), so a refreshed gain that is still at least
+            // the best stale one is the true maximum
+            size_t num_selected = 0;
+            while (num_selected < params.frames_per_camera && !heap.empty()) {
+                const size_t idx = heap.top().second;
+                heap.pop();
+
+                const double g = gain(candidates[idx]);
+                if (!heap.empty() && g < heap.top().first) {
+                    heap.emplace(g, idx);
+                    continue;
+                }
+                if (g <= 0.0) {
+                    break;// everything saturated, more frames add nothing
+                }
+
+                for (int cell: candidates[idx].cells) {
+                    cell_count[cell]++;
+                }
+                pose_count[candidates[idx].pose_bin]++;
+
+                // Every camera has its own slots, cameras are selected concurrently
+                const TimeCamId &tcid = candidates[idx].tcid;
+                selected.set(selected.frame_index(tcid.frame_id), tcid.cam_id, *candidates[idx].ccd);
+                num_selected++;
+            }
+
+            const int covered = static_cast<int>(
+                    std::count_if(cell_count.begin(), cell_count.end(), [](int c) { return c > 0; }));
+            spdlog::debug("Selected {} of {} frames, covering {} of {} cells", num_selected, candidates.size(),
+                          covered, num_cells);
+        }
+    }// namespace
+
+    CalibCornerTable select_frames(const CalibCornerTable &corners,
+                                   const Eigen::aligned_vector<Eigen::Vector2i> &resolution,
+                                   const FrameSelectionParams &params) {
+        // Candidates per camera, in timestamp order so that the result is deterministic
+        std::vector<std::vector<Candidate>> candidates;
+        for (const auto &kv: corners) {
+            if (kv.second.size() < std::max<size_t>(params.min_corners, 1)) {
+                continue;
+            }
+            if (candidates.size() <= kv.first.cam_id) {
+                candidates.resize(kv.first.cam_id + 1);
+            }
+            candidates[kv.first.cam_id].push_back({kv.first, &kv.second, {}, 0});
+        }
+
+        CalibCornerTable selected;
+        selected.reset_like(corners);
+
+        tbb::parallel_for(size_t(0), candidates.size(), [&](size_t cam_id) {
+            auto &cam_candidates = candidates[cam_id];
+            std::sort(cam_candidates.begin(), cam_candidates.end(), [](const Candidate &a, const Candidate &b) {
+                return a.tcid.frame_id < b.tcid.frame_id;
+            });
+
+            Eigen::Vector2d res = Eigen::Vector2d::Zero();
+            if (cam_id < resolution.size()) {
+                res = resolution[cam_id].cast<double>();
+            }
+            if (res.minCoeff() <= 0.0) {
+                for (const auto &cand: cam_candidates) {
+                    for (size_t i = 0; i < cand.ccd->size(); i++) {
+                        res = res.cwiseMax(cand.ccd->corner(i) + Eigen::Vector2d::Ones());
+                    }
+                }
+            }
+
+            select_camera(cam_candidates, res, params, selected);
+        });
+
+        return selected;
+    }
+}// namespace basalt
@@ -0,0 +1,372 @@
+#include "calibration/intrinsics_solver.hpp"
+#include "calibration/board_pose.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+
+namespace basalt {
+    namespace {
+        // Floor of the Levenberg-Marquardt damping, keeps unobserved parameters from making the system singular
+        constexpr double MIN_DIAGONAL = 1e-6;
+        constexpr double MAX_LAMBDA = 1e10;
+
+        struct Observation {
+            Eigen::Vector3d p_a;// corner in the target frame
+            Eigen::Vector2d uv; // detected corner [px]
+        };
+
+        struct Frame {
+            size_t index;// row in the corner table
+            int64_t timestamp;
+            std::vector<Observation> observations;
+        };
+
+        // Robust cost of a squared residual and the weight of its normal equations
+        inline double huber(double sq_norm, double threshold, double &weight) {
+            const double norm = std::sqrt(sq_norm);
+            if (norm <= threshold) {
+                weight = 1.0;
+                return sq_norm;
+            }
+            weight = threshold / norm;
+            return 2.0 * threshold * norm - threshold * threshold;
+        }
+
+        // Levenberg-Marquardt on the intrinsics of one camera model and the target poses of its frames
+        template<class Cam>
+        class ModelSolver {
+        public:
+            static constexpr int N = Cam::N;
+
+            using VecN = Eigen::Matrix<double, N, 1>;
+            using MatNN = Eigen::Matrix<double, N, N>;
+            using Mat2N = Eigen::Matrix<double, 2, N>;
+            using Mat6N = Eigen::Matrix<double, 6, N>;
+            using Vec6 = Eigen::Matrix<double, 6, 1>;
+            using Mat6 = Eigen::Matrix<double, 6, 6>;
+
+            ModelSolver(const std::vector<Frame> &frames, const IntrinsicsSolverOptions &options)
+                : frames(frames), options(options), blocks(frames.size()) {}
+
+            // Refines cam and T_c_a in place
+            void run(Cam &cam, Eigen::aligned_vector<Sophus::SE3d> &T_c_a, IntrinsicsResult &result) {
+                this->linearize(cam, T_c_a);
+                double cost = this->total_cost();
+                size_t num_residuals = this->total_residuals();
+                result.initial_rms = this->rms();
+
+                double lambda = this->options.initial_lambda;
+                Eigen::aligned_vector<Sophus::SE3d> T_c_a_new(T_c_a.size());
+                std::vector<double> frame_costs(this->frames.size());
+                std::vector<size_t> frame_residuals(this->frames.size());
+
+                for (result.num_iterations = 0; result.num_iterations < this->options.max_iterations;
+                     result.num_iterations++) {
+                    const VecN inc = this->step(lambda);
+
+                    Cam cam_new = cam;
+                    cam_new += inc;
+                    tbb::parallel_for(size_t(0), this->frames.size(), [&](size_t f) {
+                        T_c_a_new[f] = Sophus::SE3d::exp(this->blocks[f].inc) * T_c_a[f];
+                        frame_costs[f] = this->frame_cost(cam_new, T_c_a_new[f], f, frame_residuals[f]);
+                    });
+
+                    double new_cost = 0;
+                    size_t new_num_residuals = 0;
+                    for (size_t f = 0; f < this->frames.size(); f++) {
+                        new_cost += frame_costs[f];
+                        new_num_residuals += frame_residuals[f];
+                    }
+
+                    // Corners that stop projecting would lower the cost without a better fit
+                    if (new_num_residuals >= num_residuals && new_cost < cost) {
+                        const double decrease = (cost - new_cost) / std::max(cost, 1e-30);
+                        cam = cam_new;
+                        std::swap(T_c_a, T_c_a_new);
+                        lambda = std::max(lambda / 3.0, 1e-12);
+
+                        this->linearize(cam, T_c_a);
+                        cost = this->total_cost();
+                        num_residuals = this->total_residuals();
+
+                        spdlog::debug("Intrinsics iteration {}: cost {:.6g}, lambda {:.2g}", result.num_iterations,
+                                      cost, lambda);
+                        if (decrease < this->options.function_tolerance) {
+                            result.converged = true;
+                            result.num_iterations++;
+                            break;
+                        }
+                    } else {
+                        lambda *= 4.0;
+                        if (lambda > MAX_LAMBDA) {
+                            // No step lowers the cost anymore, at a minimum up to numerical precision
+                            result.converged = true;
+                            break;
+                        }
+                    }
+                }
+
+                result.rms = this->rms();
+                result.num_corners = num_residuals;
+            }
+
+        private:
+            // Normal equations of one frame and its share of those of the intrinsics
+            struct FrameBlocks {
+                Mat6 H_pp;
+                Mat6N H_pc;
+                Vec6 b_p;
+                MatNN H_cc;
+                VecN b_c;
+                double cost;
+                double sq_error;
+                size_t num_residuals;
+
+                // Schur complement terms of the current step, and the pose increment
+                MatNN S;
+                VecN s_b;
+                Mat6N A_inv_H_pc;
+                Vec6 A_inv_b_p;
+                Vec6 inc;
+
+                EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+            };
+
+            double frame_cost(const Cam &cam, const Sophus::SE3d &T_c_a, size_t f, size_t &num_residuals) const {
+                double cost = 0;
+                num_residuals = 0;
+                for (const Observation &o: this->frames[f].observations) {
+                    Eigen::Vector2d proj;
+                    const Eigen::Vector3d p_c = T_c_a * o.p_a;
+                    if (!cam.project(Eigen::Vector4d(p_c.x(), p_c.y(), p_c.z(), 1.0), proj)) {
+                        continue;
+                    }
+                    double weight;
+                    cost += 0.5 * huber((proj - o.uv).squaredNorm(), this->options.huber_threshold, weight);
+                    num_residuals++;
+                }
+                return cost;
+            }
+
+            void linearize(const Cam &cam, const Eigen::aligned_vector<Sophus::SE3d> &T_c_a) {
+                tbb::parallel_for(size_t(0), this->frames.size(), [&](size_t f) {
+                    FrameBlocks &blk = this->blocks[f];
+                    blk.H_pp.setZero();
+                    blk.H_pc.setZero();
+                    blk.b_p.setZero();
+                    blk.H_cc.setZero();
+                    blk.b_c.setZero();
+                    blk.cost = 0;
+                    blk.sq_error = 0;
+                    blk.num_residuals = 0;
+
+                    for (const Observation &o: this->frames[f].observations) {
+                        const Eigen::Vector3d p_c = T_c_a[f] * o.p_a;
+
+                        Eigen::Vector2d proj;
+                        Eigen::Matrix<double, 2, 4> d_proj_d_p;
+                        Mat2N d_proj_d_param;
+                        if (!cam.project(Eigen::Vector4d(p_c.x(), p_c.y(), p_c.z(), 1.0), proj, &d_proj_d_p,
+                                         &d_proj_d_param)) {
+                            continue;
+                        }
+
+                        const Eigen::Vector2d r = proj - o.uv;
+                        double weight;
+                        blk.cost += 0.5 * huber(r.squaredNorm(), this->options.huber_threshold, weight);
+                        blk.sq_error += r.squaredNorm();
+                        blk.num_residuals++;
+
+                        // Poses are updated as exp(inc) * T_c_a, translation first
+                        Eigen::Matrix<double, 2, 6> d_proj_d_pose;
+                        d_proj_d_pose.leftCols<3>() = d_proj_d_p.leftCols<3>();
+                        d_proj_d_pose.rightCols<3>() = -d_proj_d_p.leftCols<3>() * Sophus::SO3d::hat(p_c);
+
+                        blk.H_pp += weight * d_proj_d_pose.transpose() * d_proj_d_pose;
+                        blk.H_pc += weight * d_proj_d_pose.transpose() * d_proj_d_param;
+                        blk.b_p += weight * d_proj_d_pose.transpose() * r;
+                        blk.H_cc += weight * d_proj_d_param.transpose() * d_proj_d_param;
+                        blk.b_c += weight * d_proj_d_param.transpose() * r;
+                    }
+                });
+            }
+
+            /*
+             * Damped step of the intrinsics, the pose increments are left in the frame blocks. The pose blocks are
+             * eliminated frame by frame, in parallel, and summed in frame order so that the result does not depend on
+             * the number of threads.
+             * */
+            VecN step(double lambda) {
+                tbb::parallel_for(size_t(0), this->frames.size(), [&](size_t f) {
+                    FrameBlocks &blk = this->blocks[f];
+                    Mat6 A = blk.H_pp;
+                    A.diagonal() += lambda * blk.H_pp.diagonal().cwiseMax(MIN_DIAGONAL);
+
+                    const Eigen::LDLT<Mat6> ldlt(A);
+                    blk.A_inv_H_pc = ldlt.solve(blk.H_pc);
+                    blk.A_inv_b_p = ldlt.solve(blk.b_p);
+                    blk.S = blk.H_pc.transpose() * blk.A_inv_H_pc;
+                    blk.s_b = blk.H_pc.transpose() * blk.A_inv_b_p;
+                });
+
+                MatNN S = MatNN::Zero();
+                VecN b = VecN::Zero();
+                for (const FrameBlocks &blk: this->blocks) {
+                    S += blk.H_cc - blk.S;
+                    b += blk.b_c - blk.s_b;
+                }
+                S.diagonal() += lambda * S.diagonal().cwiseMax(MIN_DIAGONAL);
+                const VecN inc = -S.ldlt().solve(b);
+
+                for (FrameBlocks &blk: this->blocks) {
+                    blk.inc = -(blk.A_inv_b_p + blk.A_inv_H_pc * inc);
+                }
+                return inc;
+            }
+
+            double total_cost() const {
+                double cost = 0;
+                for (const FrameBlocks &blk: this->blocks) {
+                    cost += blk.cost;
+                }
+                return cost;
+            }
+
+            size_t total_residuals() const {
+                size_t num = 0;
+                for (const FrameBlocks &blk: this->blocks) {
+                    num += blk.num_residuals;
+                }
+                return num;
+            }
+
+            double rms() const {
+                double sq_error = 0;
+                for (const FrameBlocks &blk: this->blocks) {
+                    sq_error += blk.sq_error;
+                }
+                const size_t num = this->total_residuals();
+                return num > 0 ? std::sqrt(sq_error / static_cast<double>(num)) : 0.0;
+            }
+
+            const std::vector<Frame> &frames;
+            const IntrinsicsSolverOptions &options;
+            Eigen::aligned_vector<FrameBlocks> blocks;
+        };
+    }// namespace
+
+    IntrinsicsSolver::IntrinsicsSolver(const Eigen::aligned_vector<Eigen::Vector3d> &board_corners,
+                                       const IntrinsicsSolverOptions &options)
+        : board_corners(board_corners), options(options) {}
+
+    IntrinsicsResult IntrinsicsSolver::solve(const CalibCornerTable &corners, size_t cam,
+                                             const GenericCamera<double> &initial,
+                                             const CalibInitPoseMap *init_poses) const {
+        IntrinsicsResult result;
+        result.intrinsics = initial;
+
+        std::vector<Frame> candidates;
+        for (size_t f = 0; f < corners.get_num_frames(); f++) {
+            const CompactCornerData *ccd = cam < corners.get_num_cams() ? corners.get(f, cam) : nullptr;
+            if (!ccd || ccd->size() < this->options.min_corners) {
+                continue;
+            }
+
+            Frame frame;
+            frame.index = f;
+            frame.timestamp = corners.get_timestamps()[f];
+            for (size_t i = 0; i < ccd->size(); i++) {
+                const size_t id = static_cast<size_t>(ccd->id(i));
+                if (id < this->board_corners.size()) {
+                    frame.observations.push_back({this->board_corners[id], ccd->corner(i)});
+                }
+            }
+            if (frame.observations.size() >= this->options.min_corners) {
+                candidates.push_back(std::move(frame));
+            }
+        }
+
+        Eigen::aligned_vector<Sophus::SE3d> candidate_poses(candidates.size());
+        std::vector<uint8_t> has_pose(candidates.size(), 0);
+        tbb::parallel_for(size_t(0), candidates.size(), [&](size_t f) {
+            const TimeCamId tcid(candidates[f].timestamp, cam);
+            if (init_poses) {
+                const auto it = init_poses->find(tcid);
+                if (it != init_poses->end()) {
+                    candidate_poses[f] = it->second.T_a_c.inverse();
+                    has_pose[f] = 1;
+                    return;
+                }
+            }
+
+            CalibInitPoseData pose;
+            has_pose[f] = estimate_board_pose(initial, this->board_corners, *corners.get(candidates[f].index, cam),
+                                              this->options.board_pose, std::hash<TimeCamId>()(tcid), pose);
+            candidate_poses[f] = pose.T_a_c.inverse();
+        });
+
+        std::vector<Frame> frames;
+        Eigen::aligned_vector<Sophus::SE3d> T_c_a;
+        for (size_t f = 0; f < candidates.size(); f++) {
+            if (has_pose[f]) {
+                frames.push_back(std::move(candidates[f]));
+                T_c_a.push_back(candidate_poses[f]);
+            }
+        }
+
+        if (frames.size() < this->options.min_frames) {
+            spdlog::warn("Camera {} has {} usable frames, at least {} are needed to calibrate its intrinsics", cam,
+                         frames.size(), this->options.min_frames);
+            return result;
+        }
+
+        std::visit(
+                [&](const auto &initial_cam) {
+                    using Cam = std::decay_t<decltype(initial_cam)>;
+                    Cam refined = initial_cam;
+                    ModelSolver<Cam>(frames, this->options).run(refined, T_c_a, result);
+                    result.intrinsics.variant = refined;
+                },
+                initial.variant);
+
+        for (size_t f = 0; f < frames.size(); f++) {
+            result.timestamps.push_back(frames[f].timestamp);
+            result.T_a_c.push_back(T_c_a[f].inverse());
+        }
+
+        spdlog::info("Camera {} ({}): {} frames, {} corners, reprojection error {:.3f} px -> {:.3f} px in {} "
+                     "iterations",
+                     cam, initial.getName(), frames.size(), result.num_corners, result.initial_rms, result.rms,
+                     result.num_iterations);
+        return result;
+    }
+
+    Calibration<double> IntrinsicsSolver::solve(const CalibCornerTable &corners, const Calibration<double> &prior,
+                                                std::vector<IntrinsicsResult> *results,
+                                                const CalibInitPoseMap *init_poses) const {
+        if (corners.get_num_cams() > prior.intrinsics.size()) {
+            throw std::invalid_argument("corners of " + std::to_string(corners.get_num_cams()) +
+                                        " cameras, but the prior has " + std::to_string(prior.intrinsics.size()));
+        }
+
+        std::vector<IntrinsicsResult> cam_results(prior.intrinsics.size());
+        tbb::parallel_for(size_t(0), prior.intrinsics.size(), [&](size_t cam) {
+            cam_results[cam] = this->solve(corners, cam, prior.intrinsics[cam], init_poses);
+        });
+
+        Calibration<double> calib = prior;
+        for (size_t cam = 0; cam < cam_results.size(); cam++) {
+            calib.intrinsics[cam] = cam_results[cam].intrinsics;
+        }
+        if (results) {
+            *results = std::move(cam_results);
+        }
+        return calib;
+    }
+}// namespace basalt
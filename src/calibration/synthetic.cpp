@@ -0,0 +1,451 @@
+#include "io/dataset_io.h"
+#include "calibration/synthetic.hpp"
+
+#include <apriltags/TagFamily.h>
+#include <apriltags/Tag16h5.h>
+#include <apriltags/Tag36h11.h>
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace basalt {
+    namespace {
+        constexpr int64_t START_NS = 1'000'000'000;
+
+        // Gray levels of black and white print and of the background around the board
+        constexpr float BLACK = 30.f;
+        constexpr float WHITE = 220.f;
+        constexpr float BACKGROUND = 90.f;
+
+        // The board hangs upright on a wall, gravity points along -y of the board frame
+        const Eigen::Vector3d GRAVITY_W(0.0, -9.81, 0.0);
+
+        // Separable Gaussian blur with clamped borders, in place
+        void gaussian_blur(std::vector<float> &img, int w, int h, double sigma) {
+            const int radius = static_cast<int>(std::ceil(3.0 * sigma));
+            std::vector<float> kernel(2 * radius + 1);
+            float sum = 0.f;
+            for (int i = -radius; i <= radius; i++) {
+                kernel[i + radius] = static_cast<float>(std::exp(-0.5 * i * i / (sigma * sigma)));
+                sum += kernel[i + radius];
+            }
+            for (float &k: kernel) {
+                k /= sum;
+            }
+
+            std::vector<float> tmp(img.size());
+            for (int y = 0; y < h; y++) {
+                const float *src = &img[y * w];
+                for (int x = 0; x < w; x++) {
+                    float acc = 0.f;
+                    for (int i = -radius; i <= radius; i++) {
+                        acc += kernel[i + radius] * src[std::clamp(x + i, 0, w - 1)];
+                    }
+                    tmp[y * w + x] = acc;
+                }
+            }
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    float acc = 0.f;
+                    for (int i = -radius; i <= radius; i++) {
+                        acc += kernel[i + radius] * tmp[std::clamp(y + i, 0, h - 1) * w + x];
+                    }
+                    img[y * w + x] = acc;
+                }
+            }
+        }
+
+        sensor_msgs::ImagePtr to_image_msg(const ManagedImage<uint16_t> &img, const std::string &encoding,
+                                           const ros::Time &stamp, uint32_t seq) {
+            sensor_msgs::ImagePtr msg(new sensor_msgs::Image);
+            msg->header.stamp = stamp;
+            msg->header.seq = seq;
+            msg->width = img.w;
+            msg->height = img.h;
+            msg->encoding = encoding;
+            msg->is_bigendian = false;
+
+            if (encoding == "mono16") {
+                msg->step = img.w * sizeof(uint16_t);
+                msg->data.resize(msg->step * img.h);
+                for (size_t y = 0; y < img.h; y++) {
+                    std::memcpy(&msg->data[y * msg->step], img.RowPtr(y), msg->step);
+                }
+            } else {
+                msg->step = img.w;
+                msg->data.resize(msg->step * img.h);
+                for (size_t y = 0; y < img.h; y++) {
+                    const uint16_t *row = img.RowPtr(y);
+                    for (size_t x = 0; x < img.w; x++) {
+                        msg->data[y * msg->step + x] = static_cast<uint8_t>(row[x] >> 8);
+                    }
+                }
+            }
+            return msg;
+        }
+
+        ros::Time to_ros_time(int64_t timestamp_ns) {
+            ros::Time t;
+            t.fromNSec(timestamp_ns);
+            return t;
+        }
+    }// namespace
+
+    SyntheticTarget SyntheticTarget::aprilgrid(const AprilGrid &grid) {
+        const AprilTags::TagCodes *codes = nullptr;
+        if (grid.getTagFamily() == "36h11") {
+            codes = &AprilTags::tagCodes36h11;
+        } else if (grid.getTagFamily() == "16h5") {
+            codes = &AprilTags::tagCodes16h5;
+        } else {
+            throw std::runtime_error("tagFamily not supported: " + grid.getTagFamily());
+        }
+
+        SyntheticTarget target;
+        target.target_type = "aprilgrid";
+        target.tag_cols = grid.getTagCols();
+        target.tag_rows = grid.getTagRows();
+        target.tag_size = grid.getTagSize();
+        target.tag_pitch = grid.getTagSize() * (1.0 + grid.getTagSpacing());
+        target.tag_bits = static_cast<int>(std::lround(std::sqrt(codes->bits)));
+
+        const int num_tags = target.tag_cols * target.tag_rows;
+        const int low_id = static_cast<int>(grid.getLowId());
+        if (low_id < 0 || low_id + num_tags > static_cast<int>(codes->codes.size())) {
+            throw std::runtime_error("AprilGrid has more tags than the " + grid.getTagFamily() + " family");
+        }
+        target.tag_codes.assign(codes->codes.begin() + low_id, codes->codes.begin() + low_id + num_tags);
+        target.corners = aprilgrid_corners(grid);
+
+        // One tag spacing of white around the tags
+        const double gap = target.tag_pitch - target.tag_size;
+        target.min_xy = Eigen::Vector2d(-gap, -gap);
+        target.max_xy = Eigen::Vector2d(target.tag_cols * target.tag_pitch, target.tag_rows * target.tag_pitch);
+        return target;
+    }
+
+    SyntheticTarget SyntheticTarget::checkerboard(int cols, int rows, double square_size) {
+        SyntheticTarget target;
+        target.corners = checkerboard_corners(cols, rows, square_size);
+        target.target_type = "checkerboard";
+        target.is_checkerboard = true;
+        target.cb_cols = cols;
+        target.cb_rows = rows;
+        target.square_size = square_size;
+
+        // The outer ring of squares and one square of white around them
+        target.min_xy = Eigen::Vector2d(-2 * square_size, -2 * square_size);
+        target.max_xy = Eigen::Vector2d((cols + 1) * square_size, (rows + 1) * square_size);
+        return target;
+    }
+
+    float SyntheticTarget::reflectance(double x, double y) const {
+        if (x < this->min_xy.x() || y < this->min_xy.y() || x >= this->max_xy.x() || y >= this->max_xy.y()) {
+            return -1.f;
+        }
+
+        if (this->is_checkerboard) {
+            const int i = static_cast<int>(std::floor(x / this->square_size)) + 1;
+            const int j = static_cast<int>(std::floor(y / this->square_size)) + 1;
+            if (i < 0 || j < 0 || i > this->cb_cols || j > this->cb_rows) {
+                return 1.f;
+            }
+            return (i + j) % 2 == 0 ? 0.f : 1.f;
+        }
+
+        if (x < 0 || y < 0) {
+            return 1.f;
+        }
+        const int tx = static_cast<int>(x / this->tag_pitch);
+        const int ty = static_cast<int>(y / this->tag_pitch);
+        const double u = x - tx * this->tag_pitch;
+        const double v = y - ty * this->tag_pitch;
+        if (tx >= this->tag_cols || ty >= this->tag_rows || u >= this->tag_size || v >= this->tag_size) {
+            return 1.f;
+        }
+
+        // A tag is tag_bits data bits inside a black border of 2 bits, the first bit is at the top left
+        const int cells = this->tag_bits + 4;
+        const int cu = std::min(cells - 1, static_cast<int>(u / this->tag_size * cells));
+        const int cv = std::min(cells - 1, static_cast<int>(v / this->tag_size * cells));
+        if (cu < 2 || cv < 2 || cu >= cells - 2 || cv >= cells - 2) {
+            return 0.f;
+        }
+        const int col = cu - 2;
+        const int row = cells - 3 - cv;
+        const int bit = this->tag_bits * this->tag_bits - 1 - (row * this->tag_bits + col);
+        return static_cast<float>((this->tag_codes[ty * this->tag_cols + tx] >> bit) & 1);
+    }
+
+    Eigen::Vector3d SyntheticTarget::center() const {
+        Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+        for (const auto &c: this->corners) {
+            sum += c;
+        }
+        return sum / static_cast<double>(this->corners.size());
+    }
+
+    SyntheticRenderer::SyntheticRenderer(const SyntheticTarget &target, const Calibration<double> &calib,
+                                         const SyntheticConfig &config)
+        : target(target), calib(calib), config(config) {
+        if (calib.intrinsics.empty() || calib.intrinsics.size() != calib.resolution.size() ||
+            calib.intrinsics.size() != calib.T_i_c.size()) {
+            throw std::invalid_argument("camera model needs intrinsics, resolution and extrinsics of every camera");
+        }
+        if (config.supersampling < 1 || config.camera_rate <= 0 || config.imu_rate <= 0) {
+            throw std::invalid_argument("supersampling and rates must be positive");
+        }
+        if (config.encoding != "mono8" && config.encoding != "mono16") {
+            throw std::invalid_argument("unsupported encoding " + config.encoding);
+        }
+
+        const int ss = config.supersampling;
+        this->rays.resize(calib.intrinsics.size());
+        for (size_t cam = 0; cam < calib.intrinsics.size(); cam++) {
+            const int w = calib.resolution[cam].x();
+            const int h = calib.resolution[cam].y();
+            auto &cam_rays = this->rays[cam];
+            cam_rays.resize(static_cast<size_t>(w) * h * ss * ss);
+
+            tbb::parallel_for(tbb::blocked_range<int>(0, h), [&](const tbb::blocked_range<int> &range) {
+                for (int y = range.begin(); y != range.end(); y++) {
+                    for (int x = 0; x < w; x++) {
+                        Eigen::Vector3f *ray = &cam_rays[(static_cast<size_t>(y) * w + x) * ss * ss];
+                        for (int sy = 0; sy < ss; sy++) {
+                            for (int sx = 0; sx < ss; sx++) {
+                                // Pixel centers are at integer coordinates
+                                const Eigen::Vector2d p(x + (sx + 0.5) / ss - 0.5, y + (sy + 0.5) / ss - 0.5);
+                                Eigen::Vector4d r;
+                                if (calib.intrinsics[cam].unproject(p, r)) {
+                                    *ray = r.head<3>().normalized().cast<float>();
+                                } else {
+                                    ray->setConstant(std::numeric_limits<float>::quiet_NaN());
+                                }
+                                ray++;
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    Sophus::SE3d SyntheticRenderer::pose(double t) const {
+        // Incommensurate frequencies, so the trajectory does not repeat within typical durations
+        const double two_pi = 2.0 * M_PI;
+        const double a = this->config.amplitude;
+        const double max_angle = this->config.max_angle;
+
+        const Eigen::Vector3d look_at = this->target.center();
+        const Eigen::Vector3d p_w_c = look_at + Eigen::Vector3d(a * std::sin(two_pi * 0.13 * t),
+                                                                a * std::sin(two_pi * 0.17 * t + 1.0),
+                                                                this->config.distance +
+                                                                        a * std::sin(two_pi * 0.07 * t + 2.0));
+
+        // Camera z towards the target center, x along the board x, so the board appears upright
+        const Eigen::Vector3d z = (look_at - p_w_c).normalized();
+        const Eigen::Vector3d x = z.cross(Eigen::Vector3d::UnitY()).normalized();
+        Eigen::Matrix3d R_w_c;
+        R_w_c.col(0) = x;
+        R_w_c.col(1) = z.cross(x);
+        R_w_c.col(2) = z;
+
+        const Eigen::Vector3d tilt(0.25 * max_angle * std::sin(two_pi * 0.19 * t),
+                                   0.25 * max_angle * std::sin(two_pi * 0.23 * t + 0.5),
+                                   max_angle * std::sin(two_pi * 0.11 * t + 1.5));
+
+        const Sophus::SE3d T_w_c(Sophus::SO3d(R_w_c) * Sophus::SO3d::exp(tilt), p_w_c);
+        return T_w_c * this->calib.T_i_c[0].inverse();
+    }
+
+    size_t SyntheticRenderer::num_frames() const {
+        return static_cast<size_t>(std::floor(this->config.duration * this->config.camera_rate)) + 1;
+    }
+
+    int64_t SyntheticRenderer::frame_timestamp_ns(size_t frame) const {
+        return START_NS + std::llround(frame * 1e9 / this->config.camera_rate);
+    }
+
+    double SyntheticRenderer::trajectory_time(int64_t timestamp_ns) const {
+        return (timestamp_ns - START_NS) * 1e-9;
+    }
+
+    ManagedImage<uint16_t> SyntheticRenderer::render(size_t cam, const Sophus::SE3d &T_w_i,
+                                                     uint32_t noise_seed) const {
+        const int w = this->calib.resolution[cam].x();
+        const int h = this->calib.resolution[cam].y();
+        const int ss = this->config.supersampling;
+        const int num_samples = ss * ss;
+
+        const Sophus::SE3d T_w_c = T_w_i * this->calib.T_i_c[cam];
+        const Eigen::Matrix3f R_w_c = T_w_c.rotationMatrix().cast<float>();
+        const Eigen::Vector3d o = T_w_c.translation();
+
+        std::vector<float> img(static_cast<size_t>(w) * h);
+        const Eigen::Vector3f *ray = this->rays[cam].data();
+        for (size_t i = 0; i < img.size(); i++) {
+            float acc = 0.f;
+            for (int s = 0; s < num_samples; s++, ray++) {
+                const Eigen::Vector3f d = R_w_c * *ray;
+
+                // Only the printed side, in front of the camera, is visible
+                float value = BACKGROUND;
+                if (o.z() > 0 && d.z() < 0) {
+                    const double dist = -o.z() / d.z();
+                    const float r = this->target.reflectance(o.x() + dist * d.x(), o.y() + dist * d.y());
+                    if (r >= 0.f) {
+                        value = BLACK + (WHITE - BLACK) * r;
+                    }
+                }
+                acc += value;
+            }
+            img[i] = acc / num_samples;
+        }
+
+        if (this->config.blur_sigma > 0) {
+            gaussian_blur(img, w, h, this->config.blur_sigma);
+        }
+
+        std::mt19937 rng(noise_seed);
+        std::normal_distribution<float> noise(0.f, static_cast<float>(this->config.noise_sigma));
+        const bool add_noise = this->config.noise_sigma > 0;
+
+        // 16 bit like the images RosbagDataset returns, mono8 keeps only the upper byte
+        ManagedImage<uint16_t> res(w, h);
+        for (int y = 0; y < h; y++) {
+            uint16_t *row = res.RowPtr(y);
+            for (int x = 0; x < w; x++) {
+                float v = img[y * w + x] + (add_noise ? noise(rng) : 0.f);
+                v = std::clamp(v * 256.f, 0.f, 65535.f);
+                row[x] = static_cast<uint16_t>(v);
+            }
+        }
+        return res;
+    }
+
+    CalibCornerData SyntheticRenderer::project_corners(size_t cam, const Sophus::SE3d &T_w_i) const {
+        const Sophus::SE3d T_w_c = T_w_i * this->calib.T_i_c[cam];
+        const Sophus::SE3d T_c_w = T_w_c.inverse();
+        const Eigen::Vector2d res = this->calib.resolution[cam].cast<double>();
+
+        // Behind the board nothing is visible
+        CalibCornerData ccd;
+        if (T_w_c.translation().z() <= 0) {
+            return ccd;
+        }
+
+        const auto &corners = this->target.get_corners();
+        for (size_t id = 0; id < corners.size(); id++) {
+            const Eigen::Vector3d p_c = T_c_w * corners[id];
+            Eigen::Vector4d p(p_c.x(), p_c.y(), p_c.z(), 1.0);
+            Eigen::Vector2d proj;
+            if (p_c.z() > 0 && this->calib.intrinsics[cam].project(p, proj) && proj.x() >= 0 && proj.y() >= 0 &&
+                proj.x() < res.x() - 1 && proj.y() < res.y() - 1) {
+                ccd.corners.push_back(proj);
+                ccd.corner_ids.push_back(static_cast<int>(id));
+                ccd.radii.push_back(0.0);
+            }
+        }
+        return ccd;
+    }
+
+    size_t SyntheticRenderer::write_bag(const std::string &path) const {
+        rosbag::Bag bag;
+        bag.open(path, rosbag::bagmode::Write);
+
+        const size_t num_cams = this->get_num_cams();
+        const size_t num_frames = this->num_frames();
+        const int64_t end_ns = this->frame_timestamp_ns(num_frames - 1);
+
+        // Frames are rendered in batches, enough to keep every thread busy while bounding the memory
+        const size_t batch_size = 2 * static_cast<size_t>(tbb::this_task_arena::max_concurrency());
+        std::vector<ManagedImage<uint16_t>> images;
+
+        size_t imu_sample = 0;
+        auto write_imu_until = [&](int64_t t_end_ns) {
+            for (;; imu_sample++) {
+                const int64_t t_ns = START_NS + std::llround(imu_sample * 1e9 / this->config.imu_rate);
+                if (t_ns > t_end_ns) {
+                    break;
+                }
+
+                // Central differences of the trajectory, angular velocity and specific force in the IMU frame
+                const double t = this->trajectory_time(t_ns);
+                const double dt = 1e-3;
+                const Sophus::SE3d T0 = this->pose(t - dt), T1 = this->pose(t), T2 = this->pose(t + dt);
+                const Eigen::Vector3d gyro = (T0.so3().inverse() * T2.so3()).log() / (2 * dt);
+                const Eigen::Vector3d a_w =
+                        (T2.translation() - 2 * T1.translation() + T0.translation()) / (dt * dt);
+                const Eigen::Vector3d accel = T1.so3().inverse() * (a_w - GRAVITY_W);
+
+                sensor_msgs::Imu msg;
+                msg.header.stamp = to_ros_time(t_ns);
+                msg.header.seq = static_cast<uint32_t>(imu_sample);
+                msg.angular_velocity.x = gyro.x();
+                msg.angular_velocity.y = gyro.y();
+                msg.angular_velocity.z = gyro.z();
+                msg.linear_acceleration.x = accel.x();
+                msg.linear_acceleration.y = accel.y();
+                msg.linear_acceleration.z = accel.z();
+                bag.write("/imu0", msg.header.stamp, msg);
+            }
+        };
+
+        auto write_pose = [&](int64_t t_ns, uint32_t seq) {
+            const Sophus::SE3d T_w_i = this->pose(this->trajectory_time(t_ns));
+            const Eigen::Quaterniond q = T_w_i.unit_quaternion();
+
+            geometry_msgs::PoseStamped msg;
+            msg.header.stamp = to_ros_time(t_ns);
+            msg.header.seq = seq;
+            msg.pose.position.x = T_w_i.translation().x();
+            msg.pose.position.y = T_w_i.translation().y();
+            msg.pose.position.z = T_w_i.translation().z();
+            msg.pose.orientation.x = q.x();
+            msg.pose.orientation.y = q.y();
+            msg.pose.orientation.z = q.z();
+            msg.pose.orientation.w = q.w();
+            bag.write("/gt/pose", msg.header.stamp, msg);
+        };
+
+        for (size_t first = 0; first < num_frames; first += batch_size) {
+            const size_t last = std::min(num_frames, first + batch_size);
+            images.resize((last - first) * num_cams);
+
+            tbb::parallel_for(size_t(0), images.size(), [&](size_t i) {
+                const size_t frame = first + i / num_cams;
+                const size_t cam = i % num_cams;
+                const Sophus::SE3d T_w_i = this->pose(this->trajectory_time(this->frame_timestamp_ns(frame)));
+                images[i] = this->render(cam, T_w_i, this->config.seed + static_cast<uint32_t>(frame * num_cams + cam));
+            });
+
+            for (size_t frame = first; frame < last; frame++) {
+                const int64_t t_ns = this->frame_timestamp_ns(frame);
+                write_imu_until(t_ns);
+                write_pose(t_ns, static_cast<uint32_t>(frame));
+
+                const ros::Time stamp = to_ros_time(t_ns);
+                for (size_t cam = 0; cam < num_cams; cam++) {
+                    const auto msg = to_image_msg(images[(frame - first) * num_cams + cam], this->config.encoding,
+                                                  stamp, static_cast<uint32_t>(frame));
+                    bag.write("/cam" + std::to_string(cam) + "/image_raw", stamp, msg);
+                }
+            }
+            spdlog::debug("Wrote {} of {} frames to {}", last, num_frames, path);
+        }
+
+        // RosbagDataset ignores the last pose, one more past the last frame keeps every frame covered
+        write_imu_until(end_ns);
+        write_pose(end_ns + std::llround(1e9 / this->config.camera_rate), static_cast<uint32_t>(num_frames));
+
+        bag.close();
+        return num_frames;
+    }
+}// namespace basalt
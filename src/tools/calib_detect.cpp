@@ -0,0 +1,482 @@
+/*
+ * Headless corner detection, for build servers and containers without a display. Only links non_gui.
+ *
+ * All bags are processed concurrently in one process. Each bag is a task of a single tbb::task_group and the parallel
+ * loop of Calibrator::detectCorners nests inside of it, so every bag and every frame is scheduled by the same work
+ * stealing scheduler.
+ *
+ * With --benchmark, bags are processed one after the other and every detector backend runs on the whole bag in turn,
+ * so their timings do not interfere.
+ * */
+#include "calibration/calibrator.hpp"
+#include "calibration/detector_registry.hpp"
+#include "calibration/frame_selection.hpp"
+#include "cli.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+    using basalt::cli::parse_double;
+    using basalt::cli::parse_int;
+
+    struct Options {
+        std::vector<std::string> bags;
+
+        std::string aprilgrid_path;
+        int cb_width = 0;
+        int cb_height = 0;
+
+        bool adaptive_thresh = true;
+        bool normalize_image = true;
+        bool filter_quads = true;
+        bool fast_check = true;
+        bool enable_subpix_refine = true;
+        int pyramid_level = 0;
+
+        // AprilGrid quad decimation, 0 for automatic selection from the camera prior
+        int quad_decimate = 1;
+        std::string prior_path;
+        double max_distance = 2.0;
+
+        // Backends from the DetectorRegistry, empty for the default backend of the target
+        std::vector<std::string> detectors;
+        bool benchmark = false;
+        bool list_detectors = false;
+
+        bool roi_tracking = false;
+        bool prefilter = false;
+
+        basalt::FrameQualityThresholds quality;
+        bool filter_quality = false;
+
+        size_t select_frames = 0;
+
+        bool use_cache = true;
+        bool write_json = true;
+        bool write_csv = false;
+        int num_threads = 0;
+        bool verbose = false;
+    };
+
+    void print_usage(const char *prog) {
+        std::printf(
+                "Usage: %s [options] <bag>...\n"
+                "\n"
+                "Target (exactly one):\n"
+                "  --aprilgrid <config.json>    AprilGrid target configuration\n"
+                "  --checkerboard <cols>x<rows> OpenCV checkerboard, number of inner corners\n"
+                "\n"
+                "Detector:\n"
+                "  --detector <name>            Detector backend (default: the built-in one of the target)\n"
+                "  --list-detectors             List the detector backends and exit\n"
+                "  --benchmark                  Compare the speed and yield of detector backends on the bags, all\n"
+                "                               backends of the target or those given with --detector. Writes no\n"
+                "                               output files\n"
+                "\n"
+                "Checkerboard options:\n"
+                "  --no-adaptive-thresh         Disable CALIB_CB_ADAPTIVE_THRESH\n"
+                "  --no-normalize-image         Disable CALIB_CB_NORMALIZE_IMAGE\n"
+                "  --no-filter-quads            Disable CALIB_CB_FILTER_QUADS\n"
+                "  --no-fast-check              Disable CALIB_CB_FAST_CHECK\n"
+                "  --no-subpix                  Disable sub-pixel refinement\n"
+                "  --pyramid-level <n>          Search the board at 1/2^n resolution (default 0)\n"
+                "\n"
+                "AprilGrid options:\n"
+                "  --quad-decimate <n|auto>     Search AprilTag outlines at 1/n resolution (default 1), auto picks\n"
+                "                               n from the tag size in the image, needs --prior\n"
+                "  --prior <camera.json>        Camera model for --quad-decimate auto\n"
+                "  --max-distance <m>           Farthest target distance for --quad-decimate auto (default 2)\n"
+                "\n"
+                "Detection options:\n"
+                "  --roi-tracking               Seed each frame's search with the previous frame's corners\n"
+                "  --prefilter                  Skip frames without a plausible board\n"
+                "\n"
+                "Frame quality filter, drops frames from the JSON and CSV outputs (the cache keeps them):\n"
+                "  --min-sharpness <v>          Minimum variance of the Laplacian\n"
+                "  --max-underexposed <f>       Maximum fraction of black pixels\n"
+                "  --max-overexposed <f>        Maximum fraction of saturated pixels\n"
+                "  --max-motion <v>             Maximum mean absolute difference to the previous frame\n"
+                "\n"
+                "Frame selection, for the JSON and CSV outputs (the cache keeps all frames):\n"
+                "  --select-frames <k>          Keep at most k frames per camera, chosen for corner coverage and\n"
+                "                               board pose diversity\n"
+                "\n"
+                "General:\n"
+                "  --no-cache                   Ignore existing caches, always run detection\n"
+                "  --no-json                    Only write the binary cache\n"
+                "  --kalibr-csv                 Also write the corners as a Kalibr style CSV next to the JSON\n"
+                "  --threads <n>                Number of worker threads (default: all cores)\n"
+                "  -v, --verbose                Debug logging\n"
+                "  -h, --help                   Show this message\n",
+                prog);
+    }
+
+    // Returns false on invalid arguments
+    bool parse_args(int argc, char *argv[], Options &opt) {
+        basalt::cli::Args args(argc, argv);
+        while (args.next()) {
+            const std::string &arg = args.arg();
+
+            if (arg == "-h" || arg == "--help") {
+                print_usage(argv[0]);
+                std::exit(EXIT_SUCCESS);
+            } else if (arg == "--aprilgrid") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.aprilgrid_path = v;
+            } else if (arg == "--checkerboard") {
+                const char *v = args.value();
+                if (!v || std::sscanf(v, "%dx%d", &opt.cb_width, &opt.cb_height) != 2 ||
+                    opt.cb_width < 2 || opt.cb_height < 2) {
+                    spdlog::error("--checkerboard expects <cols>x<rows>, e.g. 8x6");
+                    return false;
+                }
+            } else if (arg == "--detector") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.detectors.emplace_back(v);
+            } else if (arg == "--list-detectors") {
+                opt.list_detectors = true;
+            } else if (arg == "--benchmark") {
+                opt.benchmark = true;
+            } else if (arg == "--no-adaptive-thresh") {
+                opt.adaptive_thresh = false;
+            } else if (arg == "--no-normalize-image") {
+                opt.normalize_image = false;
+            } else if (arg == "--no-filter-quads") {
+                opt.filter_quads = false;
+            } else if (arg == "--no-fast-check") {
+                opt.fast_check = false;
+            } else if (arg == "--no-subpix") {
+                opt.enable_subpix_refine = false;
+            } else if (arg == "--pyramid-level") {
+                const char *v = args.value();
+                if (!v || !parse_int(v, opt.pyramid_level) || opt.pyramid_level < 0) {
+                    spdlog::error("--pyramid-level expects a non-negative integer");
+                    return false;
+                }
+            } else if (arg == "--quad-decimate") {
+                const char *v = args.value();
+                if (v && std::strcmp(v, "auto") == 0) {
+                    opt.quad_decimate = 0;
+                } else if (!v || !parse_int(v, opt.quad_decimate) || opt.quad_decimate < 1) {
+                    spdlog::error("--quad-decimate expects a positive integer or auto");
+                    return false;
+                }
+            } else if (arg == "--prior") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.prior_path = v;
+            } else if (arg == "--max-distance") {
+                const char *v = args.value();
+                if (!v || !parse_double(v, opt.max_distance) || opt.max_distance <= 0) {
+                    spdlog::error("--max-distance expects a positive number");
+                    return false;
+                }
+            } else if (arg == "--roi-tracking") {
+                opt.roi_tracking = true;
+            } else if (arg == "--prefilter") {
+                opt.prefilter = true;
+            } else if (arg == "--min-sharpness" || arg == "--max-underexposed" || arg == "--max-overexposed" ||
+                       arg == "--max-motion") {
+                double *threshold = arg == "--min-sharpness"      ? &opt.quality.min_sharpness
+                                    : arg == "--max-underexposed" ? &opt.quality.max_underexposed
+                                    : arg == "--max-overexposed"  ? &opt.quality.max_overexposed
+                                                                  : &opt.quality.max_motion;
+                const char *v = args.value();
+                if (!v || !parse_double(v, *threshold)) {
+                    spdlog::error("{} expects a number", arg);
+                    return false;
+                }
+                opt.filter_quality = true;
+            } else if (arg == "--select-frames") {
+                const char *v = args.value();
+                int k = 0;
+                if (!v || !parse_int(v, k) || k < 1) {
+                    spdlog::error("--select-frames expects a positive integer");
+                    return false;
+                }
+                opt.select_frames = static_cast<size_t>(k);
+            } else if (arg == "--no-cache") {
+                opt.use_cache = false;
+            } else if (arg == "--no-json") {
+                opt.write_json = false;
+            } else if (arg == "--kalibr-csv") {
+                opt.write_csv = true;
+            } else if (arg == "--threads") {
+                const char *v = args.value();
+                if (!v || !parse_int(v, opt.num_threads) || opt.num_threads < 1) {
+                    spdlog::error("--threads expects a positive integer");
+                    return false;
+                }
+            } else if (arg == "-v" || arg == "--verbose") {
+                opt.verbose = true;
+            } else if (!arg.empty() && arg[0] == '-') {
+                spdlog::error("Unknown option {}", arg);
+                return false;
+            } else {
+                opt.bags.push_back(arg);
+            }
+        }
+
+        if (opt.list_detectors) {
+            return true;
+        }
+        if (opt.bags.empty()) {
+            spdlog::error("No bags given");
+            return false;
+        }
+        if (opt.aprilgrid_path.empty() == (opt.cb_width == 0)) {
+            spdlog::error("Specify exactly one of --aprilgrid or --checkerboard");
+            return false;
+        }
+
+        if (opt.quad_decimate == 0 && opt.prior_path.empty()) {
+            spdlog::error("--quad-decimate auto needs the camera model, see --prior");
+            return false;
+        }
+
+        const std::string target = opt.aprilgrid_path.empty() ? "checkerboard" : "aprilgrid";
+        const auto backends = basalt::DetectorRegistry::get_instance().list(target);
+        for (const auto &name: opt.detectors) {
+            if (std::none_of(backends.begin(), backends.end(), [&](const auto &b) { return b.name == name; })) {
+                spdlog::error("{} is not a detector for {} targets, see --list-detectors", name, target);
+                return false;
+            }
+        }
+        if (opt.detectors.size() > 1 && !opt.benchmark) {
+            spdlog::error("Several detectors are only allowed with --benchmark");
+            return false;
+        }
+        if (opt.detectors.empty()) {
+            if (opt.benchmark) {
+                for (const auto &b: backends) {
+                    opt.detectors.push_back(b.name);
+                }
+            } else {
+                opt.detectors.emplace_back(target == "aprilgrid" ? "aprilgrid" : "checkerboard_opencv");
+            }
+        }
+        return true;
+    }
+
+    void list_detectors() {
+        for (const auto &b: basalt::DetectorRegistry::get_instance().list()) {
+            std::printf("  %-24s %-14s %s\n", b.name.c_str(), b.target.c_str(), b.description.c_str());
+        }
+    }
+
+    /*
+     * Params are created per bag. AprilGridParams owns the tag detector, which is shared by all threads working on
+     * the same bag, one instance per bag keeps the bags independent.
+     * */
+    std::shared_ptr<basalt::CalibParams> make_params(const Options &opt, const std::string &detector,
+                                                     const std::shared_ptr<basalt::AprilGrid> &april_grid,
+                                                     const std::shared_ptr<basalt::Calibration<double>> &camera_prior) {
+        basalt::DetectorConfig config;
+        config.april_grid = april_grid;
+        config.quad_decimate = opt.quad_decimate;
+        config.camera_prior = camera_prior;
+        config.max_target_distance = opt.max_distance;
+        config.board_width = opt.cb_width;
+        config.board_height = opt.cb_height;
+        config.adaptive_thresh = opt.adaptive_thresh;
+        config.normalize_image = opt.normalize_image;
+        config.filter_quads = opt.filter_quads;
+        config.fast_check = opt.fast_check;
+        config.enable_subpix_refine = opt.enable_subpix_refine;
+        config.pyramid_level = opt.pyramid_level;
+
+        auto params = basalt::DetectorRegistry::get_instance().create(detector, config);
+        params->set_roi_tracking(opt.roi_tracking);
+        params->set_prefilter(opt.prefilter);
+        return params;
+    }
+
+    /*
+     * Runs every detector on the bag and reports time per image, the number of images with corners (yield) and the
+     * number of corners. Image decoding is part of the time and the same for every detector.
+     * */
+    void benchmark_bag(const Options &opt, const std::string &bag,
+                       const std::shared_ptr<basalt::AprilGrid> &april_grid,
+                       const std::shared_ptr<basalt::Calibration<double>> &camera_prior) {
+        auto dataset = std::make_shared<basalt::RosbagDataset>(bag, false);
+
+        spdlog::info("{}: {:<24} {:>8} {:>8} {:>10} {:>10} {:>10}", bag, "detector", "images", "yield", "corners",
+                     "ms/image", "images/s");
+
+        for (const auto &detector: opt.detectors) {
+            basalt::Calibrator calibrator(dataset);
+            calibrator.set_use_cache(false);
+            calibrator.set_save_cache(false);
+
+            auto params = make_params(opt, detector, april_grid, camera_prior);
+
+            const auto t0 = std::chrono::steady_clock::now();
+            calibrator.detectCorners(params);
+            const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+
+            size_t num_images = 0, num_detections = 0, num_corners = 0;
+            for (const auto &kv: dataset->calib_corners) {
+                num_images++;
+                num_detections += !kv.second.empty();
+                num_corners += kv.second.size();
+            }
+
+            const double ms_per_image = num_images > 0 ? 1e3 * dt.count() / num_images : 0.0;
+            spdlog::info("{}: {:<24} {:>8} {:>7.1f}% {:>10} {:>10.2f} {:>10.1f}", bag, detector, num_images,
+                         num_images > 0 ? 100.0 * num_detections / num_images : 0.0, num_corners, ms_per_image,
+                         dt.count() > 0 ? num_images / dt.count() : 0.0);
+        }
+    }
+}// namespace
+
+int main(int argc, char *argv[]) {
+    basalt::cli::set_log_pattern();
+
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (opt.list_detectors) {
+        list_detectors();
+        return EXIT_SUCCESS;
+    }
+    spdlog::set_level(opt.verbose ? spdlog::level::debug : spdlog::level::info);
+
+    const int num_threads = opt.num_threads > 0 ? opt.num_threads : tbb::this_task_arena::max_concurrency();
+    tbb::global_control thread_limit(tbb::global_control::max_allowed_parallelism, num_threads);
+    spdlog::info("Processing {} bag(s) with {} threads", opt.bags.size(), num_threads);
+
+    // Target and prior are loaded once upfront, shared by all bags
+    std::shared_ptr<basalt::AprilGrid> april_grid;
+    std::shared_ptr<basalt::Calibration<double>> camera_prior;
+    try {
+        if (!opt.aprilgrid_path.empty()) {
+            april_grid = basalt::cli::load_aprilgrid(opt.aprilgrid_path);
+        }
+        if (!opt.prior_path.empty()) {
+            camera_prior = std::make_shared<basalt::Calibration<double>>(
+                    basalt::load_calibration(opt.prior_path));
+        }
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+        return EXIT_FAILURE;
+    }
+    if (april_grid && opt.quad_decimate == 0) {
+        spdlog::info("Quad decimation {} for tags of {} m up to {} m away",
+                     basalt::AprilGridParams::auto_quad_decimate(*april_grid, *camera_prior, opt.max_distance),
+                     april_grid->getTagSize(), opt.max_distance);
+    }
+
+    // Outputs default to the bag's directory, bags sharing a directory get their file name as prefix
+    std::map<fs::path, int> bags_per_dir;
+    for (const auto &bag: opt.bags) {
+        bags_per_dir[fs::absolute(bag).parent_path()]++;
+    }
+
+    std::atomic<int> num_failed{0};
+    const auto t_start = std::chrono::steady_clock::now();
+
+    if (opt.benchmark) {
+        for (const auto &bag: opt.bags) {
+            try {
+                if (!fs::exists(bag)) {
+                    throw std::runtime_error("file does not exist");
+                }
+                benchmark_bag(opt, bag, april_grid, camera_prior);
+            } catch (const std::exception &e) {
+                spdlog::error("{}: {}", bag, e.what());
+                num_failed++;
+            }
+        }
+
+        spdlog::shutdown();
+        return num_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    tbb::task_group tg;
+    for (const auto &bag: opt.bags) {
+        tg.run([&, bag]() {
+            try {
+                const auto t_bag = std::chrono::steady_clock::now();
+
+                if (!fs::exists(bag)) {
+                    throw std::runtime_error("file does not exist");
+                }
+
+                auto dataset = std::make_shared<basalt::RosbagDataset>(bag, false);
+                basalt::Calibrator calibrator(dataset);
+
+                const fs::path bag_path = fs::absolute(bag);
+                if (bags_per_dir.at(bag_path.parent_path()) > 1) {
+                    const fs::path base = bag_path.parent_path() / bag_path.stem();
+                    calibrator.set_output_paths(base.string() + "_calib-cam_detected_corners.corners",
+                                                base.string() + "_calib-cam_detected_corners.json");
+                }
+                calibrator.set_use_cache(opt.use_cache);
+                calibrator.set_frame_quality(opt.filter_quality);
+
+                calibrator.detectCorners(make_params(opt, opt.detectors.front(), april_grid, camera_prior));
+
+                if (opt.filter_quality) {
+                    const size_t num_before = dataset->calib_corners.size();
+                    dataset->calib_corners = basalt::filter_corners_by_quality(
+                            dataset->calib_corners, dataset->frame_quality, opt.quality);
+                    spdlog::info("{}: quality filter dropped {} of {} images", bag,
+                                 num_before - dataset->calib_corners.size(), num_before);
+                }
+
+                if (opt.select_frames > 0) {
+                    basalt::FrameSelectionParams selection;
+                    selection.frames_per_camera = opt.select_frames;
+
+                    const size_t num_before = dataset->calib_corners.size();
+                    dataset->calib_corners =
+                            basalt::select_frames(dataset->calib_corners, dataset->get_resolution(), selection);
+                    spdlog::info("{}: selected {} of {} images", bag, dataset->calib_corners.size(), num_before);
+                }
+
+                if (opt.write_json) {
+                    calibrator.saveJson();
+                }
+                if (opt.write_csv) {
+                    calibrator.saveCsv();
+                }
+
+                size_t num_detections = 0;
+                for (const auto &kv: dataset->calib_corners) {
+                    num_detections += !kv.second.empty();
+                }
+
+                const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t_bag;
+                spdlog::info("{}: {} images, {} with corners, {:.1f}s", bag, dataset->calib_corners.size(),
+                             num_detections, dt.count());
+            } catch (const std::exception &e) {
+                spdlog::error("{}: {}", bag, e.what());
+                num_failed++;
+            }
+        });
+    }
+    tg.wait();
+
+    const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t_start;
+    spdlog::info("Done in {:.1f}s, {} of {} bag(s) failed", dt.count(), num_failed.load(), opt.bags.size());
+
+    spdlog::shutdown();
+    return num_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+/*
+ * Calibrates camera intrinsics in process, without vk_calibrate. Corners are detected (or loaded from the corner cache)
+ * with the built-in detector of the target and fed to the IntrinsicsSolver directly, starting from a prior such as the
+ * files in priors/. The result is written in the same format as the priors, so it can be used as prior again.
+ * */
+#include "calibration/calibrator.hpp"
+#include "calibration/detector_registry.hpp"
+#include "calibration/intrinsics_solver.hpp"
+#include "cli.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+namespace {
+    using basalt::cli::parse_double;
+    using basalt::cli::parse_int;
+
+    struct Options {
+        std::string bag;
+        std::string output;
+        std::string prior_path;
+
+        std::string aprilgrid_path;
+        int cb_width = 0;
+        int cb_height = 0;
+        double square_size = 0.04;
+
+        basalt::IntrinsicsSolverOptions solver;
+
+        bool use_cache = true;
+        int num_threads = 0;
+        bool verbose = false;
+    };
+
+    void print_usage(const char *prog) {
+        std::printf(
+                "Usage: %s [options] --prior <camera.json> <bag>\n"
+                "\n"
+                "Target (exactly one):\n"
+                "  --aprilgrid <config.json>    AprilGrid target configuration\n"
+                "  --checkerboard <cols>x<rows> Checkerboard, number of inner corners\n"
+                "  --square-size <m>            Checkerboard square size (default 0.04)\n"
+                "\n"
+                "Cameras:\n"
+                "  --prior <camera.json>        Initial camera models, e.g. priors/calibration-prior-kb4.json\n"
+                "  --output <camera.json>       Result (default: calib-cam_intrinsics.json next to the bag)\n"
+                "\n"
+                "Solver:\n"
+                "  --max-iterations <n>         Levenberg-Marquardt iterations (default 50)\n"
+                "  --huber <px>                 Reprojection errors above are down weighted (default 2)\n"
+                "  --min-corners <n>            Frames with fewer corners are not used (default 8)\n"
+                "  --inlier-threshold <px>      RANSAC threshold of the initial target poses (default 2)\n"
+                "\n"
+                "General:\n"
+                "  --no-cache                   Ignore existing corner caches, always run detection\n"
+                "  --threads <n>                Number of worker threads (default: all cores)\n"
+                "  -v, --verbose                Debug logging\n"
+                "  -h, --help                   Show this message\n",
+                prog);
+    }
+
+    // Returns false on invalid arguments
+    bool parse_args(int argc, char *argv[], Options &opt) {
+        basalt::cli::Args args(argc, argv);
+        while (args.next()) {
+            const std::string &arg = args.arg();
+
+            if (arg == "-h" || arg == "--help") {
+                print_usage(argv[0]);
+                std::exit(EXIT_SUCCESS);
+            } else if (arg == "--aprilgrid") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.aprilgrid_path = v;
+            } else if (arg == "--checkerboard") {
+                const char *v = args.value();
+                if (!v || std::sscanf(v, "%dx%d", &opt.cb_width, &opt.cb_height) != 2 ||
+                    opt.cb_width < 2 || opt.cb_height < 2) {
+                    spdlog::error("--checkerboard expects <cols>x<rows>, e.g. 8x6");
+                    return false;
+                }
+            } else if (arg == "--square-size") {
+                const char *v = args.value();
+                if (!v || !parse_double(v, opt.square_size) || opt.square_size <= 0) {
+                    spdlog::error("--square-size expects a positive number");
+                    return false;
+                }
+            } else if (arg == "--prior") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.prior_path = v;
+            } else if (arg == "--output") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.output = v;
+            } else if (arg == "--max-iterations") {
+                const char *v = args.value();
+                if (!v || !parse_int(v, opt.solver.max_iterations) || opt.solver.max_iterations < 1) {
+                    spdlog::error("--max-iterations expects a positive integer");
+                    return false;
+                }
+            } else if (arg == "--huber") {
+                const char *v = args.value();
+                if (!v || !parse_double(v, opt.solver.huber_threshold) || opt.solver.huber_threshold <= 0) {
+                    spdlog::error("--huber expects a positive number");
+                    return false;
+                }
+            } else if (arg == "--min-corners") {
+                const char *v = args.value();
+                int n = 0;
+                if (!v || !parse_int(v, n) || n < 4) {
+                    spdlog::error("--min-corners expects an integer of at least 4");
+                    return false;
+                }
+                opt.solver.min_corners = static_cast<size_t>(n);
+            } else if (arg == "--inlier-threshold") {
+                const char *v = args.value();
+                if (!v || !parse_double(v, opt.solver.board_pose.inlier_threshold) ||
+                    opt.solver.board_pose.inlier_threshold <= 0) {
+                    spdlog::error("--inlier-threshold expects a positive number");
+                    return false;
+                }
+            } else if (arg == "--no-cache") {
+                opt.use_cache = false;
+            } else if (arg == "--threads") {
+                const char *v = args.value();
+                if (!v || !parse_int(v, opt.num_threads) || opt.num_threads < 1) {
+                    spdlog::error("--threads expects a positive integer");
+                    return false;
+                }
+            } else if (arg == "-v" || arg == "--verbose") {
+                opt.verbose = true;
+            } else if (!arg.empty() && arg[0] == '-') {
+                spdlog::error("Unknown option {}", arg);
+                return false;
+            } else if (opt.bag.empty()) {
+                opt.bag = arg;
+            } else {
+                spdlog::error("Only one bag can be given");
+                return false;
+            }
+        }
+
+        if (opt.bag.empty()) {
+            spdlog::error("No bag given");
+            return false;
+        }
+        if (opt.prior_path.empty()) {
+            spdlog::error("No initial camera model given, see --prior");
+            return false;
+        }
+        if (opt.aprilgrid_path.empty() == (opt.cb_width == 0)) {
+            spdlog::error("Specify exactly one of --aprilgrid or --checkerboard");
+            return false;
+        }
+        return true;
+    }
+}// namespace
+
+int main(int argc, char *argv[]) {
+    basalt::cli::set_log_pattern();
+
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    spdlog::set_level(opt.verbose ? spdlog::level::debug : spdlog::level::info);
+
+    const int num_threads = opt.num_threads > 0 ? opt.num_threads : tbb::this_task_arena::max_concurrency();
+    tbb::global_control thread_limit(tbb::global_control::max_allowed_parallelism, num_threads);
+
+    try {
+        if (!basalt::fs::exists(opt.bag)) {
+            throw std::runtime_error("bag " + opt.bag + " does not exist");
+        }
+        const basalt::Calibration<double> prior = basalt::load_calibration(opt.prior_path);
+
+        basalt::DetectorConfig config;
+        std::string detector;
+        std::shared_ptr<basalt::AprilGrid> april_grid;
+        if (opt.aprilgrid_path.empty()) {
+            detector = "checkerboard_opencv";
+            config.board_width = opt.cb_width;
+            config.board_height = opt.cb_height;
+        } else {
+            detector = "aprilgrid";
+            april_grid = basalt::cli::load_aprilgrid(opt.aprilgrid_path);
+            config.april_grid = april_grid;
+        }
+        const Eigen::aligned_vector<Eigen::Vector3d> board_corners =
+                april_grid ? basalt::aprilgrid_corners(*april_grid)
+                           : basalt::checkerboard_corners(opt.cb_width, opt.cb_height, opt.square_size);
+
+        auto dataset = std::make_shared<basalt::RosbagDataset>(opt.bag, false);
+        basalt::Calibrator calibrator(dataset);
+        calibrator.set_use_cache(opt.use_cache);
+        calibrator.detectCorners(basalt::DetectorRegistry::get_instance().create(detector, config));
+
+        const auto t0 = std::chrono::steady_clock::now();
+        calibrator.computeInitPoses(prior, board_corners, opt.solver.board_pose);
+
+        std::vector<basalt::IntrinsicsResult> results;
+        const basalt::IntrinsicsSolver solver(board_corners, opt.solver);
+        const basalt::Calibration<double> calib =
+                solver.solve(dataset->calib_corners, prior, &results, &dataset->calib_init_poses);
+        const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+
+        for (size_t cam = 0; cam < results.size(); cam++) {
+            const auto &r = results[cam];
+            if (!r.converged) {
+                spdlog::warn("Camera {} did not converge, {} frames, reprojection error {:.3f} px", cam,
+                             r.timestamps.size(), r.rms);
+            }
+        }
+
+        basalt::fs::path output = opt.output;
+        if (output.empty()) {
+            output = basalt::fs::absolute(opt.bag).parent_path() / "calib-cam_intrinsics.json";
+        }
+        std::ofstream os(output);
+        if (!os.is_open()) {
+            throw std::runtime_error("could not write " + output.string());
+        }
+        {
+            cereal::JSONOutputArchive archive(os);
+            archive(calib);
+        }
+
+        spdlog::info("Calibrated {} camera(s) in {:.2f} s with {} threads, wrote {}", results.size(), dt.count(),
+                     num_threads, output.string());
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    spdlog::shutdown();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,495 @@
+/*
+ * Accuracy and throughput regression harness of the detector backends. Every backend runs on a synthetic bag with
+ * ground truth (see calib_synth) and is scored against the ground truth corners:
+ *   fps              images per second, image decoding included
+ *   detection rate   fraction of images with the board in view that gave corners
+ *   corner recall    fraction of the ground truth corners of those images detected at the right place
+ *   rms              error of the correctly detected corners [px]
+ *   false positives  detected corners far from the ground truth of their id, and the tags they belong to
+ *
+ * The results are compared to a baseline file, any regression beyond the tolerances makes the run fail. A missing
+ * baseline is written from the current results.
+ * */
+#include "calibration/calibrator.hpp"
+#include "calibration/detector_registry.hpp"
+#include "calibration/synthetic.hpp"
+#include "cli.hpp"
+
+#include <cereal/archives/json.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/set.hpp>
+#include <cereal/types/string.hpp>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    using basalt::cli::parse_int;
+
+    struct Options {
+        std::string bag;
+        std::string prior_path;
+        std::string baseline_path;
+
+        std::string aprilgrid_path;
+        int cb_width = 0;
+        int cb_height = 0;
+        double square_size = 0.04;
+
+        // Only used when the bag is generated
+        basalt::SyntheticConfig config;
+        bool regenerate = false;
+
+        std::vector<std::string> detectors;
+        bool update_baseline = false;
+
+        // Quad decimation of the AprilGrid detector, 0 for automatic
+        int quad_decimate = 1;
+
+        // A detected corner further than this from the ground truth of its id is a false positive [px]
+        double outlier_px = 2.0;
+
+        // Allowed regressions relative to the baseline
+        double rate_tolerance = 0.01;// absolute, for detection rate and corner recall
+        double rms_tolerance = 0.1;  // relative
+        double fps_tolerance = 0.25; // relative, 0 disables the check
+
+        int num_threads = 0;
+        bool verbose = false;
+    };
+
+    struct DetectionMetrics {
+        size_t images = 0;
+        double fps = 0;
+        double detection_rate = 0;
+        double corner_recall = 0;
+        double rms_px = 0;
+        size_t false_positives = 0;
+        std::set<int> false_positive_ids;
+
+        template<class Archive>
+        void serialize(Archive &ar) {
+            ar(cereal::make_nvp("images", images), cereal::make_nvp("fps", fps),
+               cereal::make_nvp("detection_rate", detection_rate), cereal::make_nvp("corner_recall", corner_recall),
+               cereal::make_nvp("rms_px", rms_px), cereal::make_nvp("false_positives", false_positives),
+               cereal::make_nvp("false_positive_ids", false_positive_ids));
+        }
+    };
+
+    struct Baseline {
+        int num_threads = 0;
+        int quad_decimate = 1;// 0 is auto
+        std::map<std::string, DetectionMetrics> backends;
+
+        template<class Archive>
+        void serialize(Archive &ar) {
+            ar(cereal::make_nvp("num_threads", num_threads), cereal::make_nvp("quad_decimate", quad_decimate),
+               cereal::make_nvp("backends", backends));
+        }
+    };
+
+    void print_usage(const char *prog) {
+        std::printf(
+                "Usage: %s [options] --prior <camera.json> --bag <synthetic.bag> --baseline <baseline.json>\n"
+                "\n"
+                "Target (exactly one, the one the bag was rendered with):\n"
+                "  --aprilgrid <config.json>    AprilGrid target configuration\n"
+                "  --checkerboard <cols>x<rows> Checkerboard, number of inner corners\n"
+                "  --square-size <m>            Checkerboard square size (default 0.04)\n"
+                "\n"
+                "Data:\n"
+                "  --prior <camera.json>        Camera model the bag was rendered with\n"
+                "  --bag <path>                 Synthetic bag with ground truth poses, generated if missing\n"
+                "  --regenerate                 Generate the bag even if it exists\n"
+                "  --duration <s>               Length of a generated bag (default 10)\n"
+                "  --seed <n>                   Noise seed of a generated bag (default 42)\n"
+                "\n"
+                "Evaluation:\n"
+                "  --detector <name>            Backend to evaluate, repeatable (default: all of the target)\n"
+                "  --baseline <path>            Baseline to compare to, written if it does not exist\n"
+                "  --update-baseline            Overwrite the baseline with the current results\n"
+                "  --outlier <px>               Distance from the ground truth that makes a false positive\n"
+                "                               (default 2)\n"
+                "  --rate-tolerance <f>         Allowed drop of detection rate and corner recall (default 0.01)\n"
+                "  --rms-tolerance <f>          Allowed relative increase of the RMS error (default 0.1)\n"
+                "  --fps-tolerance <f>          Allowed relative drop of fps, 0 to ignore fps (default 0.25)\n"
+                "\n"
+                "AprilGrid options:\n"
+                "  --quad-decimate <n|auto>     Search AprilTag outlines at 1/n resolution (default 1), auto picks\n"
+                "                               n from the tag size at the farthest distance of the trajectory.\n"
+                "                               A baseline recorded with another value is refused\n"
+                "\n"
+                "General:\n"
+                "  --threads <n>                Number of worker threads (default: all cores)\n"
+                "  -v, --verbose                Debug logging\n"
+                "  -h, --help                   Show this message\n",
+                prog);
+    }
+
+    // Returns false on invalid arguments
+    bool parse_args(int argc, char *argv[], Options &opt) {
+        basalt::cli::Args args(argc, argv);
+        while (args.next()) {
+            const std::string &arg = args.arg();
+
+            if (arg == "-h" || arg == "--help") {
+                print_usage(argv[0]);
+                std::exit(EXIT_SUCCESS);
+            } else if (arg == "--aprilgrid") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.aprilgrid_path = v;
+            } else if (arg == "--checkerboard") {
+                const char *v = args.value();
+                if (!v || std::sscanf(v, "%dx%d", &opt.cb_width, &opt.cb_height) != 2 ||
+                    opt.cb_width < 2 || opt.cb_height < 2) {
+                    spdlog::error("--checkerboard expects <cols>x<rows>, e.g. 8x6");
+                    return false;
+                }
+            } else if (arg == "--square-size") {
+                if (!args.number(opt.square_size)) return false;
+            } else if (arg == "--prior") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.prior_path = v;
+            } else if (arg == "--bag") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.bag = v;
+            } else if (arg == "--regenerate") {
+                opt.regenerate = true;
+            } else if (arg == "--duration") {
+                if (!args.number(opt.config.duration)) return false;
+            } else if (arg == "--seed") {
+                const char *v = args.value();
+                int seed = 0;
+                if (!v || !parse_int(v, seed)) {
+                    spdlog::error("--seed expects an integer");
+                    return false;
+                }
+                opt.config.seed = static_cast<uint32_t>(seed);
+            } else if (arg == "--quad-decimate") {
+                const char *v = args.value();
+                if (v && std::strcmp(v, "auto") == 0) {
+                    opt.quad_decimate = 0;
+                } else if (!v || !parse_int(v, opt.quad_decimate) || opt.quad_decimate < 1) {
+                    spdlog::error("--quad-decimate expects a positive integer or auto");
+                    return false;
+                }
+            } else if (arg == "--detector") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.detectors.emplace_back(v);
+            } else if (arg == "--baseline") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.baseline_path = v;
+            } else if (arg == "--update-baseline") {
+                opt.update_baseline = true;
+            } else if (arg == "--outlier") {
+                if (!args.number(opt.outlier_px)) return false;
+            } else if (arg == "--rate-tolerance") {
+                if (!args.number(opt.rate_tolerance)) return false;
+            } else if (arg == "--rms-tolerance") {
+                if (!args.number(opt.rms_tolerance)) return false;
+            } else if (arg == "--fps-tolerance") {
+                if (!args.number(opt.fps_tolerance)) return false;
+            } else if (arg == "--threads") {
+                const char *v = args.value();
+                if (!v || !parse_int(v, opt.num_threads) || opt.num_threads < 1) {
+                    spdlog::error("--threads expects a positive integer");
+                    return false;
+                }
+            } else if (arg == "-v" || arg == "--verbose") {
+                opt.verbose = true;
+            } else {
+                spdlog::error("Unknown argument {}", arg);
+                return false;
+            }
+        }
+
+        if (opt.bag.empty() || opt.prior_path.empty() || opt.baseline_path.empty()) {
+            spdlog::error("--bag, --prior and --baseline are required");
+            return false;
+        }
+        if (opt.aprilgrid_path.empty() == (opt.cb_width == 0)) {
+            spdlog::error("Specify exactly one of --aprilgrid or --checkerboard");
+            return false;
+        }
+
+        const std::string target = opt.aprilgrid_path.empty() ? "checkerboard" : "aprilgrid";
+        const auto backends = basalt::DetectorRegistry::get_instance().list(target);
+        for (const auto &name: opt.detectors) {
+            if (std::none_of(backends.begin(), backends.end(), [&](const auto &b) { return b.name == name; })) {
+                spdlog::error("{} is not a detector for {} targets", name, target);
+                return false;
+            }
+        }
+        if (opt.detectors.empty()) {
+            for (const auto &b: backends) {
+                opt.detectors.push_back(b.name);
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Scores the detections of one image against its ground truth. Checkerboards look the same rotated by 180
+     * degrees, their detections are also scored with reversed ids and the better of both counts.
+     * */
+    struct ImageScore {
+        size_t matched = 0;
+        double sum_sq_err = 0;
+        std::vector<int> false_positive_ids;// corner ids
+    };
+
+    ImageScore score_image(const basalt::CalibCornerData &detected, const basalt::CalibCornerData &gt,
+                           size_t num_target_corners, bool symmetric, double outlier_px) {
+        std::unordered_map<int, Eigen::Vector2d> gt_pos;
+        for (size_t i = 0; i < gt.corner_ids.size(); i++) {
+            gt_pos.emplace(gt.corner_ids[i], gt.corners[i]);
+        }
+
+        auto score = [&](bool reversed) {
+            ImageScore s;
+            for (size_t i = 0; i < detected.corner_ids.size(); i++) {
+                const int id = reversed ? static_cast<int>(num_target_corners) - 1 - detected.corner_ids[i]
+                                        : detected.corner_ids[i];
+                auto it = gt_pos.find(id);
+                const double err = it != gt_pos.end() ? (detected.corners[i] - it->second).norm() : INFINITY;
+                if (err <= outlier_px) {
+                    s.matched++;
+                    s.sum_sq_err += err * err;
+                } else {
+                    s.false_positive_ids.push_back(detected.corner_ids[i]);
+                }
+            }
+            return s;
+        };
+
+        ImageScore s = score(false);
+        if (symmetric) {
+            ImageScore r = score(true);
+            if (r.matched > s.matched) {
+                s = std::move(r);
+            }
+        }
+        return s;
+    }
+
+    DetectionMetrics evaluate(const Options &opt, const std::string &detector,
+                              const std::shared_ptr<basalt::AprilGrid> &april_grid,
+                              const std::shared_ptr<basalt::Calibration<double>> &prior,
+                              const basalt::SyntheticRenderer &renderer, const basalt::SyntheticTarget &target) {
+        auto dataset = std::make_shared<basalt::RosbagDataset>(opt.bag, false);
+        basalt::Calibrator calibrator(dataset);
+        calibrator.set_use_cache(false);
+        calibrator.set_save_cache(false);
+
+        basalt::DetectorConfig config;
+        config.april_grid = april_grid;
+        config.quad_decimate = opt.quad_decimate;
+        config.camera_prior = prior;
+        config.max_target_distance = opt.config.distance + opt.config.amplitude;
+        config.board_width = opt.cb_width;
+        config.board_height = opt.cb_height;
+        auto params = basalt::DetectorRegistry::get_instance().create(detector, config);
+
+        const auto t0 = std::chrono::steady_clock::now();
+        calibrator.detectCorners(params);
+        const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+
+        // Ground truth poses are written at the frame timestamps
+        std::unordered_map<int64_t, Sophus::SE3d> gt_poses;
+        const auto &gt_timestamps = dataset->get_gt_timestamps();
+        for (size_t i = 0; i < gt_timestamps.size(); i++) {
+            gt_poses.emplace(gt_timestamps[i], dataset->get_gt_pose_data()[i]);
+        }
+
+        const bool symmetric = target.get_target_type() == "checkerboard";
+        const size_t num_target_corners = target.get_corners().size();
+
+        // The AprilGrid detector needs 4 tags, the checkerboard detector the whole board
+        const size_t min_visible = symmetric ? num_target_corners : 16;
+
+        DetectionMetrics m;
+        // Accuracy is over all matched corners, recall only over the images that count for it
+        size_t num_detected_images = 0, num_gt_corners = 0, num_recalled = 0, num_matched = 0, num_images = 0;
+        double sum_sq_err = 0;
+        for (const auto &kv: dataset->calib_corners) {
+            num_images++;
+            auto pose = gt_poses.find(kv.first.frame_id);
+            if (pose == gt_poses.end()) {
+                continue;
+            }
+
+            const basalt::CalibCornerData gt = renderer.project_corners(kv.first.cam_id, pose->second);
+            const ImageScore s = score_image(kv.second.to_calib_corner_data(), gt, num_target_corners, symmetric,
+                                             opt.outlier_px);
+            sum_sq_err += s.sum_sq_err;
+            num_matched += s.matched;
+            m.false_positives += s.false_positive_ids.size();
+            for (int id: s.false_positive_ids) {
+                m.false_positive_ids.insert(symmetric ? id : id / 4);
+            }
+
+            if (gt.corners.size() >= min_visible) {
+                m.images++;
+                num_gt_corners += gt.corners.size();
+                num_recalled += s.matched;
+                num_detected_images += !kv.second.empty();
+            }
+        }
+
+        m.fps = dt.count() > 0 ? num_images / dt.count() : 0.0;
+        m.detection_rate = m.images > 0 ? static_cast<double>(num_detected_images) / m.images : 0.0;
+        m.corner_recall = num_gt_corners > 0 ? static_cast<double>(num_recalled) / num_gt_corners : 0.0;
+        m.rms_px = num_matched > 0 ? std::sqrt(sum_sq_err / num_matched) : 0.0;
+        return m;
+    }
+
+    // Logs every regression of current against baseline, returns their number
+    int compare(const Options &opt, const std::string &detector, const DetectionMetrics &baseline,
+                const DetectionMetrics &current, bool compare_fps) {
+        int regressions = 0;
+        auto fail = [&](const char *metric, double before, double now) {
+            spdlog::error("REGRESSION {}: {} {:.4f} -> {:.4f}", detector, metric, before, now);
+            regressions++;
+        };
+
+        if (current.detection_rate < baseline.detection_rate - opt.rate_tolerance) {
+            fail("detection rate", baseline.detection_rate, current.detection_rate);
+        }
+        if (current.corner_recall < baseline.corner_recall - opt.rate_tolerance) {
+            fail("corner recall", baseline.corner_recall, current.corner_recall);
+        }
+        // Small absolute slack, RMS of an exact detector is close to 0
+        if (current.rms_px > baseline.rms_px * (1.0 + opt.rms_tolerance) + 0.005) {
+            fail("rms [px]", baseline.rms_px, current.rms_px);
+        }
+        if (current.false_positives > baseline.false_positives) {
+            fail("false positives", baseline.false_positives, current.false_positives);
+        }
+        if (compare_fps && opt.fps_tolerance > 0 && current.fps < baseline.fps * (1.0 - opt.fps_tolerance)) {
+            fail("fps", baseline.fps, current.fps);
+        }
+        return regressions;
+    }
+
+    std::string format_ids(const std::set<int> &ids) {
+        std::string res;
+        for (int id: ids) {
+            res += (res.empty() ? "" : ",") + std::to_string(id);
+        }
+        return res.empty() ? "-" : res;
+    }
+}// namespace
+
+int main(int argc, char *argv[]) {
+    basalt::cli::set_log_pattern();
+
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    spdlog::set_level(opt.verbose ? spdlog::level::debug : spdlog::level::info);
+
+    const int num_threads = opt.num_threads > 0 ? opt.num_threads : tbb::this_task_arena::max_concurrency();
+    tbb::global_control thread_limit(tbb::global_control::max_allowed_parallelism, num_threads);
+
+    Baseline results;
+    results.num_threads = num_threads;
+    results.quad_decimate = opt.quad_decimate;
+    int regressions = 0;
+
+    try {
+        std::shared_ptr<basalt::AprilGrid> april_grid;
+        if (!opt.aprilgrid_path.empty()) {
+            april_grid = basalt::cli::load_aprilgrid(opt.aprilgrid_path);
+        }
+        const basalt::SyntheticTarget target =
+                april_grid ? basalt::SyntheticTarget::aprilgrid(*april_grid)
+                           : basalt::SyntheticTarget::checkerboard(opt.cb_width, opt.cb_height, opt.square_size);
+        const auto prior = std::make_shared<basalt::Calibration<double>>(
+                basalt::load_calibration(opt.prior_path));
+        const basalt::SyntheticRenderer renderer(target, *prior, opt.config);
+
+        if (opt.regenerate || !fs::exists(opt.bag)) {
+            spdlog::info("Generating {}", opt.bag);
+            renderer.write_bag(opt.bag);
+        }
+
+        spdlog::info("{:<24} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}  {}", "detector", "images", "fps", "rate", "recall",
+                     "rms px", "fp", "false positive ids");
+        for (const auto &detector: opt.detectors) {
+            const DetectionMetrics m = evaluate(opt, detector, april_grid, prior, renderer, target);
+            results.backends[detector] = m;
+            spdlog::info("{:<24} {:>8} {:>8.1f} {:>8.4f} {:>8.4f} {:>8.4f} {:>8}  {}", detector, m.images, m.fps,
+                         m.detection_rate, m.corner_recall, m.rms_px, m.false_positives,
+                         format_ids(m.false_positive_ids));
+        }
+
+        if (opt.update_baseline || !fs::exists(opt.baseline_path)) {
+            std::ofstream os(opt.baseline_path);
+            cereal::JSONOutputArchive archive(os);
+            archive(cereal::make_nvp("baseline", results));
+            spdlog::info("Wrote baseline {}", opt.baseline_path);
+        } else {
+            Baseline baseline;
+            {
+                std::ifstream is(opt.baseline_path);
+                cereal::JSONInputArchive archive(is);
+                archive(cereal::make_nvp("baseline", baseline));
+            }
+
+            // Detection results depend on the decimation, a baseline of another one would compare different settings
+            if (baseline.quad_decimate != opt.quad_decimate) {
+                auto name = [](int n) { return n == 0 ? std::string("auto") : std::to_string(n); };
+                throw std::runtime_error("Baseline was recorded with --quad-decimate " + name(baseline.quad_decimate) +
+                                         ", run with the same value or with --update-baseline");
+            }
+
+            // Throughput only compares on the same number of threads
+            const bool compare_fps = baseline.num_threads == num_threads;
+            if (!compare_fps) {
+                spdlog::warn("Baseline was measured with {} threads, not comparing fps", baseline.num_threads);
+            }
+
+            for (const auto &kv: results.backends) {
+                auto it = baseline.backends.find(kv.first);
+                if (it == baseline.backends.end()) {
+                    spdlog::warn("{} is not in the baseline, run with --update-baseline to add it", kv.first);
+                    continue;
+                }
+                regressions += compare(opt, kv.first, it->second, kv.second, compare_fps);
+            }
+        }
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (regressions > 0) {
+        spdlog::error("{} regression(s) against {}", regressions, opt.baseline_path);
+    } else {
+        spdlog::info("No regressions");
+    }
+
+    spdlog::shutdown();
+    return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+/*
+ * Generates calibration bags with known ground truth, for testing and benchmarking detection and calibration without
+ * hardware. A target is rendered through the cameras of a camera model along a smooth trajectory, the bag holds the
+ * images of every camera, IMU samples consistent with the trajectory and the ground truth IMU poses.
+ *
+ * Frames are rendered on all cores, see SyntheticRenderer.
+ * */
+#include "calibration/synthetic.hpp"
+#include "cli.hpp"
+
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+    using basalt::cli::parse_int;
+
+    struct Options {
+        std::string output;
+        std::string prior_path;
+
+        std::string aprilgrid_path;
+        int cb_width = 0;
+        int cb_height = 0;
+        double square_size = 0.04;
+
+        basalt::SyntheticConfig config;
+
+        int num_threads = 0;
+        bool verbose = false;
+    };
+
+    void print_usage(const char *prog) {
+        std::printf(
+                "Usage: %s [options] --prior <camera.json> <output.bag>\n"
+                "\n"
+                "Target (exactly one):\n"
+                "  --aprilgrid <config.json>    AprilGrid target configuration\n"
+                "  --checkerboard <cols>x<rows> Checkerboard, number of inner corners\n"
+                "  --square-size <m>            Checkerboard square size (default 0.04)\n"
+                "\n"
+                "Cameras:\n"
+                "  --prior <camera.json>        Camera model, e.g. priors/calibration-prior-kb4.json\n"
+                "\n"
+                "Trajectory:\n"
+                "  --duration <s>               Length of the bag (default 10)\n"
+                "  --camera-rate <hz>           Frame rate (default 20)\n"
+                "  --imu-rate <hz>              IMU rate (default 200)\n"
+                "  --distance <m>               Mean distance of the first camera to the target (default 1)\n"
+                "  --amplitude <m>              Translation amplitude along every axis (default 0.3)\n"
+                "  --max-angle <rad>            Rotation amplitude around the optical axis (default 0.4)\n"
+                "\n"
+                "Image formation:\n"
+                "  --supersampling <n>          n x n samples per pixel (default 2)\n"
+                "  --blur <px>                  Sigma of the Gaussian blur (default 0)\n"
+                "  --noise <v>                  Sigma of the noise in 8 bit gray levels (default 2)\n"
+                "  --encoding <mono8|mono16>    Image encoding (default mono8)\n"
+                "  --seed <n>                   Noise seed (default 42)\n"
+                "\n"
+                "General:\n"
+                "  --threads <n>                Number of worker threads (default: all cores)\n"
+                "  -v, --verbose                Debug logging\n"
+                "  -h, --help                   Show this message\n",
+                prog);
+    }
+
+    // Returns false on invalid arguments
+    bool parse_args(int argc, char *argv[], Options &opt) {
+        basalt::cli::Args args(argc, argv);
+        while (args.next()) {
+            const std::string &arg = args.arg();
+
+            if (arg == "-h" || arg == "--help") {
+                print_usage(argv[0]);
+                std::exit(EXIT_SUCCESS);
+            } else if (arg == "--aprilgrid") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.aprilgrid_path = v;
+            } else if (arg == "--checkerboard") {
+                const char *v = args.value();
+                if (!v || std::sscanf(v, "%dx%d", &opt.cb_width, &opt.cb_height) != 2 ||
+                    opt.cb_width < 2 || opt.cb_height < 2) {
+                    spdlog::error("--checkerboard expects <cols>x<rows>, e.g. 8x6");
+                    return false;
+                }
+            } else if (arg == "--square-size") {
+                if (!args.number(opt.square_size)) return false;
+            } else if (arg == "--prior") {
+                const char *v = args.value();
+                if (!v) return false;
+                opt.prior_path = v;
+            } else if (arg == "--duration") {
+                if (!args.number(opt.config.duration)) return false;
+            } else if (arg == "--camera-rate") {
+                if (!args.number(opt.config.camera_rate)) return false;
+            } else if (arg == "--imu-rate") {
+                if (!args.number(opt.config.imu_rate)) return false;
+            } else if (arg == "--distance") {
+                if (!args.number(opt.config.distance)) return false;
+            } else if (arg == "--amplitude") {
+                if (!args.number(opt.config.amplitude)) return false;
+            } else if (arg == "--max-angle") {
+                if (!args.number(opt.config.max_angle)) return false;
+            } else if (arg == "--supersampling") {
+                const char *v = args.value();
+                if (!v || !parse_int(v, opt.config.supersampling) || opt.config.supersampling < 1) {
+                    spdlog::error("--supersampling expects a positive integer");
+                    return false;
+                }
+            } else if (arg == "--blur") {
+                if (!args.number(opt.config.blur_sigma)) return false;
+            } else if (arg == "--noise") {
+                if (!args.number(opt.config.noise_sigma)) return false;
+            } else if (arg == "--encoding") {
+                const char *v = args.value();
+                if (!v || (std::string(v) != "mono8" && std::string(v) != "mono16")) {
+                    spdlog::error("--encoding expects mono8 or mono16");
+                    return false;
+                }
+                opt.config.encoding = v;
+            } else if (arg == "--seed") {
+                const char *v = args.value();
+                int seed = 0;
+                if (!v || !parse_int(v, seed)) {
+                    spdlog::error("--seed expects an integer");
+                    return false;
+                }
+                opt.config.seed = static_cast<uint32_t>(seed);
+            } else if (arg == "--threads") {
+                const char *v = args.value();
+                if (!v || !parse_int(v, opt.num_threads) || opt.num_threads < 1) {
+                    spdlog::error("--threads expects a positive integer");
+                    return false;
+                }
+            } else if (arg == "-v" || arg == "--verbose") {
+                opt.verbose = true;
+            } else if (!arg.empty() && arg[0] == '-') {
+                spdlog::error("Unknown option {}", arg);
+                return false;
+            } else if (opt.output.empty()) {
+                opt.output = arg;
+            } else {
+                spdlog::error("Only one output bag can be given");
+                return false;
+            }
+        }
+
+        if (opt.output.empty()) {
+            spdlog::error("No output bag given");
+            return false;
+        }
+        if (opt.prior_path.empty()) {
+            spdlog::error("No camera model given, see --prior");
+            return false;
+        }
+        if (opt.aprilgrid_path.empty() == (opt.cb_width == 0)) {
+            spdlog::error("Specify exactly one of --aprilgrid or --checkerboard");
+            return false;
+        }
+        if (opt.config.camera_rate <= 0 || opt.config.imu_rate <= 0 || opt.config.distance <= 0) {
+            spdlog::error("Rates and distance must be positive");
+            return false;
+        }
+        return true;
+    }
+}// namespace
+
+int main(int argc, char *argv[]) {
+    basalt::cli::set_log_pattern();
+
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    spdlog::set_level(opt.verbose ? spdlog::level::debug : spdlog::level::info);
+
+    const int num_threads = opt.num_threads > 0 ? opt.num_threads : tbb::this_task_arena::max_concurrency();
+    tbb::global_control thread_limit(tbb::global_control::max_allowed_parallelism, num_threads);
+
+    try {
+        const basalt::SyntheticTarget target =
+                opt.aprilgrid_path.empty()
+                        ? basalt::SyntheticTarget::checkerboard(opt.cb_width, opt.cb_height, opt.square_size)
+                        : basalt::SyntheticTarget::aprilgrid(*basalt::cli::load_aprilgrid(opt.aprilgrid_path));
+        const auto calib = basalt::load_calibration(opt.prior_path);
+
+        const auto t0 = std::chrono::steady_clock::now();
+        const basalt::SyntheticRenderer renderer(target, calib, opt.config);
+        const size_t num_frames = renderer.write_bag(opt.output);
+        const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+
+        spdlog::info("Wrote {} frames of {} camera(s) to {} in {:.1f} s with {} threads", num_frames,
+                     renderer.get_num_cams(), opt.output, dt.count(), num_threads);
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    spdlog::shutdown();
+    return EXIT_SUCCESS;
+}
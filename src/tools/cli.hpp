@@ -0,0 +1,92 @@
+#pragma once
+
+/*
+ * Command line handling shared by the tools.
+ * */
+#include "calibration/aprilgrid.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace basalt {
+    namespace cli {
+        inline void set_log_pattern() { spdlog::set_pattern("[%D %H:%M:%S] [%^%L%$] [thread %t] %v"); }
+
+        // False unless all of s is a number in the range of int
+        inline bool parse_int(const char *s, int &out) {
+            char *end = nullptr;
+            errno = 0;
+            const long v = std::strtol(s, &end, 10);
+            if (end == s || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX) {
+                return false;
+            }
+            out = static_cast<int>(v);
+            return true;
+        }
+
+        // False unless all of s is a number
+        inline bool parse_double(const char *s, double &out) {
+            char *end = nullptr;
+            out = std::strtod(s, &end);
+            return end != s && *end == '\0';
+        }
+
+        /*
+         * Steps through the arguments of argv. value() takes the value of the current option and number() parses it as
+         * a non-negative number, both log an error when it is missing or malformed.
+         * */
+        class Args {
+        public:
+            Args(int argc, char *argv[]) : argc(argc), argv(argv) {}
+
+            // Moves to the next argument, false after the last one
+            bool next() {
+                if (++this->i >= this->argc) {
+                    return false;
+                }
+                this->current = this->argv[this->i];
+                return true;
+            }
+
+            inline const std::string &arg() const { return this->current; }
+
+            const char *value() {
+                if (this->i + 1 >= this->argc) {
+                    spdlog::error("Missing value for {}", this->current);
+                    return nullptr;
+                }
+                return this->argv[++this->i];
+            }
+
+            bool number(double &out) {
+                const char *v = this->value();
+                if (!v || !parse_double(v, out) || out < 0) {
+                    spdlog::error("{} expects a non-negative number", this->current);
+                    return false;
+                }
+                return true;
+            }
+
+        private:
+            int argc;
+            char **argv;
+            int i = 0;
+            std::string current;
+        };
+
+        // The AprilGrid constructor aborts on a config it cannot open, this throws instead
+        inline std::shared_ptr<AprilGrid> load_aprilgrid(const std::string &path) {
+            if (!std::ifstream(path).is_open()) {
+                throw std::runtime_error("Could not open aprilgrid configuration: " + path);
+            }
+            return std::make_shared<AprilGrid>(path);
+        }
+    }// namespace cli
+}// namespace basalt
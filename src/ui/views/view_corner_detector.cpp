@@ -1,6 +1,8 @@
 #include "ui/views/view_corner_detector.hpp"
 
 #include "app_state.hpp"
+#include "calibration/detector_registry.hpp"
+#include "calibration/intrinsics_solver.hpp"
 
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -11,12 +13,22 @@
 
 #include <unistd.h>
 
+#include <fstream>
+
+namespace {
+    // Target name of the type in the DetectorRegistry
+    const char *registry_target(DetectionType type) {
+        return type == +DetectionType::AprilGrid ? "aprilgrid" : "checkerboard";
+    }
+}// namespace
+
 ViewCornerDetector::ViewCornerDetector()
     : View("Corner Detector"),
         show_corners(true), show_corners_rejected(false), selected_rosbag(0), selected_frame(0), selected_aprilgrid(0),
-        image_params(ImmVision::ImageParams()), detection_type(DetectionType::Checkerboard),
+        image_params(ImmVision::ImageParams()), detection_type(DetectionType::Checkerboard), detector(), roi_tracking(false), prefilter(false),
         cb_width(8), cb_height(6), cb_row_spacing(0.04f), cb_col_spacing(0.04f),
         adaptive_thresh(true), normalize_image(true), filter_quads(true), fast_check(true), enable_subpix_refine(true),
+        pyramid_level(0),
         cam_types(std::vector<std::string>({"pinhole-radtan8", "pinhole-radtan8"})){
     this->image_params.RefreshImage = true;
 }
@@ -179,6 +191,24 @@ void ViewCornerDetector::draw_vkcalibrate_popup() {
             }
         }
 
+        // Initial camera models for the in-process solver, e.g. a file in priors/
+        static std::string prior_path;
+        ImGui::InputText("Prior .json Path", &prior_path); ImGui::SameLine();
+        if (ImGui::Button("Select prior .json Path")) {
+            NFD::Guard nfdGuard;
+            NFD::UniquePath outPath;
+            nfdfilteritem_t priorFilter[1] = {{"Camera calibration .json file", "json"}};
+            nfdresult_t result = NFD::OpenDialog(outPath, priorFilter, 1);
+
+            if (result == NFD_OKAY) {
+                prior_path = outPath.get();
+            } else if (result == NFD_CANCEL) {
+                spdlog::debug("User pressed cancel.");
+            } else {
+                spdlog::error("File upload failed. Error: {}", NFD_GetError());
+            }
+        }
+
         if (ImGui::Button("Launch vk_calibrate", ImVec2(120, 0))) {
             this->launch_vkcalibrate(dataset_path, cb_path, result_path, this->cam_types);
             ImGui::CloseCurrentPopup();
@@ -186,6 +216,12 @@ void ViewCornerDetector::draw_vkcalibrate_popup() {
         ImGui::SetItemDefaultFocus();
         ImGui::SameLine();
 
+        if (ImGui::Button("Calibrate Intrinsics", ImVec2(160, 0))) {
+            this->calibrate_intrinsics(prior_path, result_path);
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+
         if (ImGui::Button("Cancel", ImVec2(120, 0))) { ImGui::CloseCurrentPopup(); }
 
         ImGui::EndPopup();
@@ -278,6 +314,25 @@ void ViewCornerDetector::draw_detection_popup() {
             ImGui::EndCombo();
         }
 
+        // Every backend of the target in the DetectorRegistry, including those registered by plugins
+        const std::string detector = this->selected_detector();
+        if (ImGui::BeginCombo("Detector", detector.c_str())) {
+            for (const auto &backend: basalt::DetectorRegistry::get_instance().list(
+                         registry_target(this->detection_type))) {
+                bool is_selected = (backend.name == detector);
+                if (ImGui::Selectable(backend.name.c_str(), is_selected)) {
+                    this->detector = backend.name;
+                }
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("%s", backend.description.c_str());
+                }
+                if (is_selected) {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+
         /*
          * Draw calibration board specific details.
          * libcbdetect is removed for now, since we are not using it. Refer to previous commits if you want to use it.
@@ -325,10 +380,17 @@ void ViewCornerDetector::draw_detection_popup() {
                 ImGui::Checkbox("Fast Check", &this->fast_check);
                 ImGui::Checkbox("Enable sub-pixel refinement",
                                 &this->enable_subpix_refine);
+                ImGui::SliderInt("Pyramid Level", &this->pyramid_level, 0, 2);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Search the board at 1/2^level resolution, refine corners at full resolution");
+                }
                 break;
             }
         }
 
+        ImGui::Checkbox("ROI tracking", &this->roi_tracking);
+        ImGui::Checkbox("Skip empty frames", &this->prefilter);
+
         if (ImGui::Button("Detect!", ImVec2(120, 0))) {
             this->detect_corners();
             ImGui::CloseCurrentPopup();
@@ -342,41 +404,60 @@ void ViewCornerDetector::draw_detection_popup() {
     }
 }
 
-void ViewCornerDetector::detect_corners() {
-    spdlog::debug("Detecting corners with {} mode", detection_type._to_string());
-
-    switch (this->detection_type) {
-        case DetectionType::AprilGrid: {
-            //NOLINTNEXTLINE
-            AppState::get_instance().submit_task([this]() {
-                auto &app_state = AppState::get_instance();
-                auto params = std::make_shared<basalt::AprilGridParams>(
-                        app_state.aprilgrid_files[this->selected_aprilgrid]);
-                auto calibrator = std::make_unique<basalt::Calibrator>(
-                        app_state.rosbag_files[this->selected_rosbag]);
-
-                calibrator->detectCorners(params);
-                this->draw_corners();
-            });
-            break;
-        }
-        case DetectionType::Checkerboard: {
-            //NOLINTNEXTLINE
-            AppState::get_instance().submit_task([this]() {
-                auto &app_state = AppState::get_instance();
-                auto params = std::make_shared<basalt::OpenCVCheckerboardParams>(
-                        this->cb_width, this->cb_height, this->adaptive_thresh, this->normalize_image,
-                        this->filter_quads, this->fast_check, this->enable_subpix_refine);
-                auto calibrator = std::make_unique<basalt::Calibrator>(
-                        app_state.rosbag_files[this->selected_rosbag]);
-
-                calibrator->detectCorners(params);
-                this->draw_corners();
-            });
-            break;
+std::string ViewCornerDetector::selected_detector() const {
+    const std::string target = registry_target(this->detection_type);
+    for (const auto &backend: basalt::DetectorRegistry::get_instance().list(target)) {
+        if (backend.name == this->detector) {
+            return this->detector;
         }
     }
+    return target == "aprilgrid" ? "aprilgrid" : "checkerboard_opencv";
+}
+
+void ViewCornerDetector::detect_corners() {
+    const std::string detector = this->selected_detector();
+    spdlog::debug("Detecting corners with {} mode, detector {}", detection_type._to_string(), detector);
+
+    auto &app_state = AppState::get_instance();
 
+    // The backend is created through the DetectorRegistry, like the command line tools do
+    basalt::DetectorConfig config;
+    if (this->detection_type == +DetectionType::AprilGrid) {
+        if (app_state.aprilgrid_files.size() == 0) {
+            spdlog::error("Load an AprilGrid before detecting it");
+            return;
+        }
+        config.april_grid = app_state.aprilgrid_files[this->selected_aprilgrid];
+    } else {
+        config.board_width = this->cb_width;
+        config.board_height = this->cb_height;
+    }
+    config.adaptive_thresh = this->adaptive_thresh;
+    config.normalize_image = this->normalize_image;
+    config.filter_quads = this->filter_quads;
+    config.fast_check = this->fast_check;
+    config.enable_subpix_refine = this->enable_subpix_refine;
+    config.pyramid_level = this->pyramid_level;
+
+    this->detections_running++;
+    //NOLINTNEXTLINE
+    AppState::get_instance().submit_task([this, detector, config]() {
+        auto &app_state = AppState::get_instance();
+        // A failed detection must still count as finished, calibrate_intrinsics waits for all of them
+        try {
+            auto params = basalt::DetectorRegistry::get_instance().create(detector, config);
+            params->set_roi_tracking(this->roi_tracking);
+            params->set_prefilter(this->prefilter);
+            auto calibrator = std::make_unique<basalt::Calibrator>(
+                    app_state.rosbag_files[this->selected_rosbag]);
+
+            calibrator->detectCorners(params);
+        } catch (const std::exception &e) {
+            spdlog::error("Corner detection failed: {}", e.what());
+        }
+        this->detections_running--;
+        this->draw_corners();
+    });
 }
 
 void ViewCornerDetector::draw_corners() {
@@ -391,7 +472,8 @@ void ViewCornerDetector::draw_corners() {
 
             for (int cam_num = 0; cam_num < app_state.rosbag_files[this->selected_rosbag]->get_num_cams(); cam_num++) {
                 auto tcid = basalt::TimeCamId(ts, cam_num);
-                const basalt::CalibCornerData &cr = app_state.rosbag_files[this->selected_rosbag]->calib_corners.at(tcid);
+                const basalt::CalibCornerData cr =
+                        app_state.rosbag_files[this->selected_rosbag]->calib_corners.at(tcid).to_calib_corner_data();
 //          const CalibCornerData &cr_rej = this->rosbag_files[this->selected]->calib_corners_rejected.at(tcid);
 
                 for (size_t i = 0; i < cr.corners.size(); i++) {
@@ -450,4 +532,47 @@ void ViewCornerDetector::launch_vkcalibrate(std::string dataset_path, std::strin
     });
 
     t.detach();
-}
\ No newline at end of file
+}
+
+void ViewCornerDetector::calibrate_intrinsics(std::string prior_path, std::string result_path) {
+    // Detection tasks reset and fill calib_corners, the corners can only be copied once they are done
+    if (this->detections_running > 0) {
+        spdlog::error("Corner detection is still running, calibrate the intrinsics once it has finished");
+        return;
+    }
+
+    // Everything the task needs is taken here on the UI thread, detection may run again while solving
+    auto &app_state = AppState::get_instance();
+    Eigen::aligned_vector<Eigen::Vector3d> board_corners;
+    try {
+        // The detected corners must be of the same target as selected for detection
+        board_corners = this->detection_type == +DetectionType::AprilGrid
+                                ? basalt::aprilgrid_corners(*app_state.aprilgrid_files[this->selected_aprilgrid])
+                                : basalt::checkerboard_corners(this->cb_width, this->cb_height, this->cb_row_spacing);
+    } catch (const std::exception &e) {
+        spdlog::error("Intrinsics calibration failed: {}", e.what());
+        return;
+    }
+    const auto corners = std::make_shared<const basalt::CalibCornerTable>(
+            app_state.rosbag_files[this->selected_rosbag]->calib_corners);
+
+    //NOLINTNEXTLINE
+    AppState::get_instance().submit_task([prior_path, result_path, board_corners, corners]() {
+        try {
+            const basalt::Calibration<double> prior = basalt::load_calibration(prior_path);
+            const basalt::IntrinsicsSolver solver(board_corners);
+            const basalt::Calibration<double> calib = solver.solve(*corners, prior);
+
+            const std::string path = result_path + "/calibration.json";
+            std::ofstream os(path);
+            if (!os.is_open()) {
+                throw std::runtime_error("could not write " + path);
+            }
+            cereal::JSONOutputArchive archive(os);
+            archive(calib);
+            spdlog::info("Wrote intrinsics to {}", path);
+        } catch (const std::exception &e) {
+            spdlog::error("Intrinsics calibration failed: {}", e.what());
+        }
+    });
+}